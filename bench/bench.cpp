@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+#include "synthrom.h"
+
+// Minimum time each repetition of a benchmark runs for
+constexpr std::chrono::nanoseconds min_repetition_time = std::chrono::milliseconds(50);
+constexpr size_t default_repetitions = 5;
+// Size of the synthetic rom used as input
+constexpr size_t bench_rom_size = 4 * 1024 * 1024;
+// Maximum size of the code and data ranges used by the per-word benchmarks
+constexpr size_t max_range_size = 0x10000;
+
+// Seed of the synthetic rom used as input
+constexpr uint64_t bench_rom_seed = 0x123456789ABCDEF;
+
+// Find the largest segment of the given type in a synthetic rom
+SynthSegment largest_segment(const SynthRom& rom, SynthSegmentType type) {
+    SynthSegment ret{type, 0, 0};
+    for (const SynthSegment& segment : rom.segments) {
+        if (segment.type == type && segment.rom_end - segment.rom_start > ret.rom_end - ret.rom_start) {
+            ret = segment;
+        }
+    }
+    return ret;
+}
+
+// Keeps the compiler from optimizing away a benchmark's result
+template <typename T>
+void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    std::string_view name;
+    // What the time is reported per, either "word" for benchmarks that process a range or "call" for the rest
+    std::string_view unit;
+    // Number of units processed per iteration
+    size_t units;
+    // Nanoseconds per unit of each repetition
+    std::vector<double> samples;
+};
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return (values.size() % 2 == 0) ? (values[mid - 1] + values[mid]) / 2.0 : values[mid];
+}
+
+// Run `func` (which processes `units` units per call) repeatedly and record the time per unit for each repetition
+template <typename Func>
+BenchResult run_bench(std::string_view name, std::string_view unit, size_t units, size_t repetitions, Func&& func) {
+    BenchResult ret{name, unit, units, {}};
+
+    // Warm up caches and lazily initialized tables
+    func();
+
+    for (size_t rep = 0; rep < repetitions; rep++) {
+        size_t iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        do {
+            func();
+            iterations++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < min_repetition_time);
+
+        double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        ret.samples.push_back(ns / static_cast<double>(iterations * units));
+    }
+
+    return ret;
+}
+
+void print_results_table(const std::vector<BenchResult>& results) {
+    fmt::print("{:<34} {:>12} {:>14} {:>10}  {}\n", "benchmark", "ns/unit", "units/s", "units", "unit");
+    for (const BenchResult& result : results) {
+        double ns_per_unit = median(result.samples);
+        fmt::print("{:<34} {:>12.3f} {:>14.0f} {:>10}  {}\n", result.name, ns_per_unit, 1e9 / ns_per_unit, result.units, result.unit);
+    }
+}
+
+void print_results_json(const std::vector<BenchResult>& results) {
+    fmt::print("{{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        double ns_per_unit = median(result.samples);
+        // Keys are named after the unit (e.g. `ns_per_word` or `ns_per_call`) so the two can't be compared by mistake
+        fmt::print("    {{\"name\": \"{0}\", \"{1}s\": {2}, \"ns_per_{1}\": {3:.6f}, \"{1}s_per_second\": {4:.1f}, \"samples_ns_per_{1}\": [",
+            result.name, result.unit, result.units, ns_per_unit, 1e9 / ns_per_unit);
+        for (size_t sample = 0; sample < result.samples.size(); sample++) {
+            fmt::print("{}{:.6f}", sample == 0 ? "" : ", ", result.samples[sample]);
+        }
+        fmt::print("]}}{}\n", i + 1 == results.size() ? "" : ",");
+    }
+    fmt::print("  ]\n}}\n");
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    size_t repetitions = default_repetitions;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--repetitions" && i + 1 < argc) {
+            repetitions = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 0));
+        } else {
+            fmt::print("Usage: {} [--json] [--repetitions N]\n", argv[0]);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    SynthRom rom = generate_synthetic_rom(SynthRomOptions{.seed = bench_rom_seed, .size = bench_rom_size});
+    std::span<const uint8_t> rom_bytes = rom.bytes;
+    size_t rom_words = (rom.bytes.size() - rom_code_start) / instruction_size;
+
+    // A code segment and a data segment of the rom to run the per-word benchmarks over
+    SynthSegment code_segment = largest_segment(rom, SynthSegmentType::code);
+    SynthSegment data_segment = largest_segment(rom, SynthSegmentType::data);
+    size_t code_start = code_segment.rom_start;
+    size_t data_start = data_segment.rom_start;
+    size_t range_size = std::min({max_range_size, code_segment.rom_end - code_start, data_segment.rom_end - data_start});
+    size_t range_words = range_size / instruction_size;
+    RomRegion code_region{code_start, code_start + range_size};
+    RomWordIndex word_index = build_rom_word_index(rom_bytes);
+
+    std::vector<BenchResult> results{};
+
+    results.push_back(run_bench("is_valid (code)", "word", range_words, repetitions, [&] {
+        size_t count = 0;
+        for (size_t offset = code_start; offset < code_start + range_size; offset += instruction_size) {
+            count += is_valid(rabbitizer::InstructionCpu{read32(rom_bytes, offset), 0});
+        }
+        do_not_optimize(count);
+    }));
+
+    results.push_back(run_bench("is_valid (data)", "word", range_words, repetitions, [&] {
+        size_t count = 0;
+        for (size_t offset = data_start; offset < data_start + range_size; offset += instruction_size) {
+            count += is_valid(rabbitizer::InstructionCpu{read32(rom_bytes, offset), 0});
+        }
+        do_not_optimize(count);
+    }));
+
+    results.push_back(run_bench("is_valid_rsp (data)", "word", range_words, repetitions, [&] {
+        size_t count = 0;
+        for (size_t offset = data_start; offset < data_start + range_size; offset += instruction_size) {
+            count += is_valid_rsp(rabbitizer::InstructionRsp{read32(rom_bytes, offset), 0});
+        }
+        do_not_optimize(count);
+    }));
+
+    results.push_back(run_bench("build_rom_word_index", "word", rom_words, repetitions, [&] {
+        do_not_optimize(build_rom_word_index(rom_bytes).fills.size());
+    }));
+
+    results.push_back(run_bench("find_return_locations", "word", rom_words, repetitions, [&] {
+        do_not_optimize(find_return_locations(rom_bytes, rom_code_start, nullptr, word_index).size());
+    }));
+
+    // The code segments are fully valid, so this walks the whole range back to the segment start
+    results.push_back(run_bench("find_code_start", "word", range_words, repetitions, [&] {
+        do_not_optimize(find_code_start(rom_bytes, code_start + range_size - instruction_size, code_start, word_index));
+    }));
+
+    // Walking forward has no bound, so start the walk at most `range_size` before where the code actually ends
+    size_t code_end = find_code_end(rom_bytes, code_start, word_index);
+    size_t end_walk_start = code_end - std::min(code_end - code_start, range_size);
+    results.push_back(run_bench("find_code_end", "word", std::max<size_t>(1, (code_end - end_walk_start) / instruction_size), repetitions, [&] {
+        do_not_optimize(find_code_end(rom_bytes, end_walk_start, word_index));
+    }));
+
+    // The trims only look at a few words near each end, so the cost doesn't scale with the region size
+    results.push_back(run_bench("trim_region", "call", 1, repetitions, [&] {
+        // Make the end land in the middle of a function so the end trim has work to do
+        RomRegion region{code_start, code_start + range_size - 6 * instruction_size};
+        trim_region(region, rom_bytes, word_index);
+        do_not_optimize(region.rom_end);
+    }));
+
+    results.push_back(run_bench("check_range_cpu", "word", range_words, repetitions, [&] {
+        do_not_optimize(check_range_cpu(code_start, code_start + range_size, rom_bytes, word_index));
+    }));
+
+    results.push_back(run_bench("count_invalid_start_instructions", "call", 1, repetitions, [&] {
+        do_not_optimize(count_invalid_start_instructions(code_region, rom_bytes));
+    }));
+
+    results.push_back(run_bench("find_code_regions (end to end)", "word", rom_words, repetitions, [&] {
+        do_not_optimize(find_code_regions(rom_bytes).size());
+    }));
+
+    if (json) {
+        print_results_json(results);
+    } else {
+        print_results_table(results);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,25 +1,298 @@
 #ifndef __FINDCODE_H__
 #define __FINDCODE_H__
 
+#include <array>
+#include <bit>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <span>
+#include <string>
+#include <string_view>
 
 #include "rabbitizer.hpp"
 
+// A region grown from return address seeds, before it's merged with its neighbors.
+// Offsets are 32 bits so candidates sort quickly, which covers any N64 rom.
+struct RegionCandidate {
+    // The grown bounds of the region, until `trim_region_candidates` trims them
+    uint32_t rom_start;
+    uint32_t rom_end;
+    // The last seed inside of the region, which decides if the region was already covered by a previous one
+    uint32_t last_seed;
+};
+
+// A run of identical words in a rom
+struct WordRun {
+    // Index of the first word of the run
+    uint32_t start_word;
+    uint32_t length;
+    uint32_t word;
+    // Whether the word is a load or store when decoded as a CPU or RSP instruction
+    bool cpu_load_store;
+    bool rsp_load_store;
+};
+
+// Runs of identical words shorter than this aren't indexed, since they can't fail a range check
+constexpr size_t min_indexed_run_length = 3;
+
+// A long run of 0x00 or 0xFF bytes, which is padding that the word by word passes can jump over
+struct FillRange {
+    size_t rom_start;
+    size_t rom_end;
+    // Whether the fill word is a valid CPU or RSP instruction, which decides if a walk over valid code continues through it
+    bool cpu_valid;
+    bool rsp_valid;
+};
+
+// Runs of 0x00 or 0xFF shorter than this are left to the word by word passes
+constexpr size_t min_fill_size = 4 * 1024;
+
+// Per-word bitmaps over a whole rom, so trimming can find branches and nonzero words without decoding anything,
+// an index of runs of identical words for the range checks, and the fill that the seed scan and region walks can skip
+struct RomWordIndex {
+    // Set for words that are unconditional non-linking branches (`b`, `j` or `jr`)
+    std::vector<uint64_t> branch_bits;
+    // Set for words that aren't zero
+    std::vector<uint64_t> nonzero_bits;
+    // Runs of at least `min_indexed_run_length` identical words, sorted by start
+    std::vector<WordRun> identical_runs;
+    // Runs of 0x00 or 0xFF of at least `min_fill_size` bytes, sorted by start
+    std::vector<FillRange> fills;
+};
+
+// A table of case addresses read by a `jr`, which is rodata
+struct JumpTable {
+    size_t rom_start;
+    size_t rom_end;
+    uint32_t vram;
+    // Rom address of the `jr` that uses the table
+    size_t jr_rom;
+};
+
+// A `jal` in a region
+struct RegionCall {
+    // Index of the calling function in the region's function list
+    size_t caller;
+    uint32_t target;
+};
+
+// Addresses referenced by a region's code, collected in a single walk over it
+struct RegionReferences {
+    // Rom addresses of the start of each function in the region
+    std::vector<size_t> function_starts;
+    // Number of `jr $ra` in each function
+    std::vector<uint32_t> return_counts;
+    // Every `jal` in the region, in order
+    std::vector<RegionCall> calls;
+    // Distinct vram targets of every `jal` in the region
+    std::vector<uint32_t> jal_targets;
+    // Distinct vram addresses built with a lui/addiu or lui/ori pair, which include function pointers
+    std::vector<uint32_t> pair_addresses;
+};
+
 struct RomRegion {
     size_t rom_start;
     size_t rom_end;
     bool has_rsp;
+    // How much the region's register usage looks like real code, from 0 (junk) to 1
+    float confidence;
+    // Jump tables used by the region's code
+    std::vector<JumpTable> jump_tables;
+    // Inferred vram address of the start of the region, or 0 if it couldn't be inferred
+    uint32_t vram;
+    // Fraction of the region's calls and function pointers that agree with the inferred vram address
+    float vram_confidence;
+    // Functions, calls and HI/LO addresses in the region, collected once for vram inference and reused by the call graph
+    RegionReferences references;
 
     RomRegion(size_t new_rom_start, size_t new_rom_end) :
-        rom_start(new_rom_start), rom_end(new_rom_end), has_rsp(false) {}
+        rom_start(new_rom_start), rom_end(new_rom_end), has_rsp(false), confidence(1.0f), jump_tables(),
+        vram(0), vram_confidence(0.0f), references() {}
+};
+
+// Results of a linear def-use pass over a region
+struct RegionDataflow {
+    size_t instruction_count;
+    // Reads of registers that were never written
+    size_t uninitialized_reads;
+    // Writes that get overwritten without being read
+    size_t unread_writes;
+    // Writes to $sp that aren't stack frame adjustments and accesses below the stack pointer
+    size_t stack_pointer_misuse;
+};
+
+// Call graph across all regions in compressed sparse row format
+struct CallGraph {
+    // Rom address of each function, sorted
+    std::vector<size_t> function_starts;
+    // Number of `jr $ra` in each function
+    std::vector<uint32_t> return_counts;
+    // The callees of function `i` are `callees[call_offsets[i]]` to `callees[call_offsets[i + 1] - 1]`
+    std::vector<uint32_t> call_offsets;
+    std::vector<uint32_t> callees;
+    // Calls whose target couldn't be mapped to a function start in any region
+    size_t unresolved_calls;
+    // Calls whose target is a function start in more than one region with an overlapping vram range (e.g. overlays),
+    // none of which is the caller's region
+    size_t ambiguous_calls;
+};
+
+enum class CompressionFormat {
+    Yay0,
+    Yaz0,
+    MIO0,
+};
+
+// A compressed block found in the rom
+struct CompressedBlock {
+    size_t rom_offset;
+    CompressionFormat format;
+    size_t decompressed_size;
+};
+
+// A code region inside of a compressed block, with offsets relative to the start of the decompressed data
+struct CompressedCodeRegion {
+    CompressedBlock container;
+    RomRegion region;
+};
+
+// Phases of a scan that are measured for `--stats`
+enum class ScanPhase {
+    read_rom,
+    endian_normalization,
+    word_index,
+    find_return_locations,
+    region_growth,
+    trimming,
+    gap_checks,
+    rsp_extension,
+    analysis,
+    output,
+    count,
+};
+
+constexpr size_t scan_phase_count = static_cast<size_t>(ScanPhase::count);
+
+// Rules in `is_valid`, `is_valid_rsp`, `is_invalid_start_instruction` and `check_range_cpu` that can reject a word
+enum class RejectRule {
+    invalid_opcode,
+    zero_base,
+    zero_output,
+    cop0_register,
+    unused_n64_instruction,
+    cache_params,
+    cop2_load_store,
+    trap,
+    ctc0_cfc0,
+    pref,
+    rsp_invalid_opcode,
+    rsp_invalid_bits,
+    rsp_zero_output,
+    rsp_cop0_register,
+    rsp_nonexistent_instruction,
+    start_nop,
+    start_invalid,
+    start_zero_output,
+    start_uninitialized_read,
+    start_unconditional_branch,
+    start_linked_jump,
+    start_jr_zero,
+    start_zero_shift,
+    start_mthi_mtlo,
+    start_cop1_branch,
+    start_trapping_arithmetic,
+    start_ra_base,
+    identical_load_store,
+    count,
+};
+
+constexpr size_t reject_rule_count = static_cast<size_t>(RejectRule::count);
+static_assert(reject_rule_count <= 64, "Rules must fit in a 64-bit mask");
+
+// Hardware performance counters recorded around each scan phase with `--perf`
+enum class PerfCounter {
+    cycles,
+    instructions,
+    branch_misses,
+    l1d_misses,
+    llc_misses,
+    dtlb_misses,
+    count,
+};
+
+constexpr size_t perf_counter_count = static_cast<size_t>(PerfCounter::count);
+
+using PerfCounterValues = std::array<uint64_t, perf_counter_count>;
+
+// Number and total size of allocations made through the global allocator
+struct AllocationCounters {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// Totals for one phase of a scan
+struct PhaseStats {
+    uint64_t nanoseconds = 0;
+    uint64_t calls = 0;
+    // Bytes of rom covered by the phase
+    uint64_t bytes = 0;
+    // Instructions decoded by the phase
+    uint64_t instructions = 0;
+    // Hardware counter totals, if `--perf` is enabled
+    PerfCounterValues counters{};
+    AllocationCounters allocations{};
+};
+
+struct ScanStats {
+    std::array<PhaseStats, scan_phase_count> phases{};
+    // Words checked by `is_valid` and `is_valid_rsp` and how many each rule rejected, if rule counters are enabled
+    uint64_t cpu_checks = 0;
+    uint64_t rsp_checks = 0;
+    std::array<uint64_t, reject_rule_count> rejections{};
+    // Allocations made by every thread, including outside of the measured phases
+    AllocationCounters allocations{};
+
+    PhaseStats& operator[](ScanPhase phase) {
+        return phases[static_cast<size_t>(phase)];
+    }
+
+    const PhaseStats& operator[](ScanPhase phase) const {
+        return phases[static_cast<size_t>(phase)];
+    }
+
+    void merge(const ScanStats& other);
 };
 
 constexpr size_t instruction_size = 4;
+// The first 0x1000 bytes of a rom are the header and IPL3, which aren't searched
+constexpr size_t rom_code_start = 0x1000;
 constexpr size_t min_region_instructions = 4;
 constexpr size_t microcode_check_threshold = 1024 * instruction_size;
 constexpr bool show_true_ranges = false;
+// Skip return address seeds in blocks that look compressed or otherwise don't look like code
+// Off until the accuracy tool shows that the block test doesn't lose recall on real roms
+constexpr bool entropy_filter = false;
+constexpr size_t entropy_block_size = 0x1000;
+// Count which rule rejects each word in `is_valid` and `is_valid_rsp`. Enabled by building with `RULE_COUNTERS=1`.
+#ifdef FINDCODE_RULE_COUNTERS
+constexpr bool rule_counters = true;
+#else
+constexpr bool rule_counters = false;
+#endif
+// Allow rules to be disabled at runtime to measure their cost and value. Enabled by building with `ABLATION=1`.
+#ifdef FINDCODE_ABLATION
+constexpr bool rule_ablation = true;
+#else
+constexpr bool rule_ablation = false;
+#endif
+// Count allocations made by each phase. Enabled by building with `ALLOC_COUNTERS=1`.
+#ifdef FINDCODE_ALLOC_COUNTERS
+constexpr bool allocation_counters = true;
+#else
+constexpr bool allocation_counters = false;
+#endif
 
 using RegisterId = rabbitizer::Registers::Cpu::GprO32;
 using FprRegisterId = rabbitizer::Registers::Cpu::Cop1O32;
@@ -53,8 +326,142 @@ inline uint32_t read32(std::span<const uint8_t> bytes, size_t offset) {
     return *reinterpret_cast<const uint32_t*>(bytes.data() + offset);
 }
 
-// Find all the regions of code in the given rom
-std::vector<RomRegion> find_code_regions(std::span<const uint8_t> rom_bytes);
+// Raw instruction field accessors, for passes that only need a few fields of each word instead of a full decode
+constexpr uint32_t instr_opcode(uint32_t word) { return word >> 26; }
+constexpr uint32_t instr_rs(uint32_t word) { return (word >> 21) & 0x1F; }
+constexpr uint32_t instr_rt(uint32_t word) { return (word >> 16) & 0x1F; }
+constexpr uint32_t instr_rd(uint32_t word) { return (word >> 11) & 0x1F; }
+constexpr uint32_t instr_funct(uint32_t word) { return word & 0x3F; }
+constexpr int32_t instr_simm(uint32_t word) { return static_cast<int16_t>(word & 0xFFFF); }
+constexpr uint32_t instr_target(uint32_t word) { return (word & 0x03FFFFFF) << 2; }
+
+constexpr uint32_t opcode_special = 0x00;
+constexpr uint32_t opcode_jal = 0x03;
+constexpr uint32_t opcode_beq = 0x04;
+constexpr uint32_t opcode_addiu = 0x09;
+constexpr uint32_t opcode_sltiu = 0x0B;
+constexpr uint32_t opcode_ori = 0x0D;
+constexpr uint32_t opcode_lui = 0x0F;
+constexpr uint32_t opcode_lw = 0x23;
+constexpr uint32_t funct_jr = 0x08;
+constexpr uint32_t funct_addu = 0x21;
+constexpr uint32_t reg_sp = 29;
+constexpr uint32_t reg_ra = 31;
+
+constexpr uint32_t jr_ra = 0x03E00008;
+
+// Range of vram addresses considered to be pointers into code (KSEG0 RDRAM)
+constexpr uint32_t code_pointer_min = 0x80000000;
+constexpr uint32_t code_pointer_max = 0x80800000;
+
+constexpr bool is_code_pointer(uint32_t word) {
+    return word >= code_pointer_min && word < code_pointer_max && (word % instruction_size) == 0;
+}
+
+// Gets the gpr an instruction writes to from its raw fields
+// Returns 0 ($zero) for instructions that don't write a gpr. jal and bal writing $ra aren't included.
+constexpr uint32_t raw_output_gpr(uint32_t word) {
+    uint32_t opcode = instr_opcode(word);
+    if (opcode == opcode_special) {
+        return instr_rd(word);
+    }
+    // Coprocessor moves to gprs (mfc, dmfc and cfc) write rt, other coprocessor instructions don't write a gpr
+    if (opcode >= 0x10 && opcode <= 0x13) {
+        return (instr_rs(word) <= 2) ? instr_rt(word) : 0;
+    }
+    // Stores, branches, jumps and fpr loads don't write a gpr
+    if ((opcode >= 0x28 && opcode <= 0x2F) || (opcode >= 0x38 && opcode <= 0x3F) || (opcode >= 0x01 && opcode <= 0x07) ||
+        (opcode >= 0x14 && opcode <= 0x17) || opcode == 0x31 || opcode == 0x35)
+    {
+        return 0;
+    }
+    return instr_rt(word);
+}
+
+// Check if an instruction is a load or store from its raw fields
+constexpr bool raw_is_memory_access(uint32_t word) {
+    uint32_t opcode = instr_opcode(word);
+    return (opcode >= 0x20 && opcode <= 0x2E) || opcode == 0x31 || opcode == 0x35 || opcode == 0x37 ||
+        opcode == 0x39 || opcode == 0x3D || opcode == 0x3F;
+}
+
+// Reads a byte from a given uint8_t span of host order words, at the given offset in big-endian order
+inline uint8_t read8_be(std::span<const uint8_t> bytes, size_t offset) {
+    if constexpr (std::endian::native == std::endian::little) {
+        return bytes[offset ^ 3];
+    } else {
+        return bytes[offset];
+    }
+}
+
+// Read a rom file from the given path and swap it (if necessary) to little-endian, exiting if it can't be used
+std::vector<uint8_t> read_rom(const char* path);
+
+// Same as `read_rom`, but returns false and sets `error` instead of printing anything or exiting, so it's safe to call from
+// worker threads. `swapped` is set if the rom had to be byteswapped.
+bool load_rom(const char* path, std::vector<uint8_t>& rom_bytes, bool& swapped, std::string& error);
+
+// Find all the regions of code in the given rom, starting the search at `code_start`
+// If `compressed_blocks` is provided, any compressed blocks seen while searching are added to it
+std::vector<RomRegion> find_code_regions(std::span<const uint8_t> rom_bytes, size_t code_start = rom_code_start,
+    std::vector<CompressedBlock>* compressed_blocks = nullptr);
+
+// Check if a word is the start of a compressed block and record it if so
+void check_compression_header(std::span<const uint8_t> rom_bytes, size_t rom_addr, std::vector<CompressedBlock>& compressed_blocks);
+
+// Decompress each of the given blocks on worker threads and find the code regions inside them
+std::vector<CompressedCodeRegion> scan_compressed_blocks(std::span<const uint8_t> rom_bytes, const std::vector<CompressedBlock>& blocks);
+
+const char* compression_format_name(CompressionFormat format);
+
+// Search a span for any instances of the instruction `jr $ra`, starting at `code_start`
+std::vector<size_t> find_return_locations(std::span<const uint8_t> rom_bytes, size_t code_start, std::vector<CompressedBlock>* compressed_blocks,
+    const RomWordIndex& word_index);
+
+// Searches backwards from the given rom address until it hits an invalid instruction or `code_start`
+size_t find_code_start(std::span<const uint8_t> rom_bytes, size_t rom_addr, size_t code_start, const RomWordIndex& word_index);
+
+// Searches forwards from the given rom address until it hits an invalid instruction
+size_t find_code_end(std::span<const uint8_t> rom_bytes, size_t rom_addr, const RomWordIndex& word_index);
+
+// Grow a candidate region from each return address seed, which must be sorted
+std::vector<RegionCandidate> grow_region_candidates(std::span<const uint8_t> rom_bytes, std::span<const size_t> seeds, size_t code_start,
+    const RomWordIndex& word_index);
+
+// Sort candidates from any number of producers by start, and combine duplicates
+void sort_region_candidates(std::vector<RegionCandidate>& candidates);
+
+// Trim every candidate in one pass, which must happen after sorting since duplicates are found by their grown start
+void trim_region_candidates(std::span<const uint8_t> rom_bytes, std::span<RegionCandidate> candidates, const RomWordIndex& word_index);
+
+// Turn sorted and trimmed candidates into regions in a single sweep, merging across valid gaps and extending RSP code
+std::vector<RomRegion> merge_region_candidates(std::span<const uint8_t> rom_bytes, std::span<const RegionCandidate> candidates,
+    const RomWordIndex& word_index);
+
+// Check if a given instruction word is an unconditional non-linking branch (i.e. `b`, `j`, or `jr`)
+bool is_unconditional_branch(uint32_t instruction_word);
+
+// Build the branch and nonzero word bitmaps, the identical word run index and the fill ranges for a rom
+RomWordIndex build_rom_word_index(std::span<const uint8_t> rom_bytes);
+
+// Find the first fill that ends after the given rom address
+std::vector<FillRange>::const_iterator find_next_fill(const RomWordIndex& word_index, size_t rom_addr);
+
+// Trims invalid start instructions and zeroes from the start of a code region, returning the new start
+size_t trim_region_start(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index);
+
+// Trims "loose" instructions from the end of a code region, returning the new end
+size_t trim_region_end(size_t rom_start, size_t rom_end, const RomWordIndex& word_index);
+
+// Trims zeroes from the start of a code region and "loose" instructions from the end
+void trim_region(RomRegion& codeseg, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index);
+
+// Find the first rom address in a range where a range check would see too many identical loads or stores in a row,
+// or `rom_end` if there isn't one
+size_t find_identical_load_store(size_t rom_start, size_t rom_end, const RomWordIndex& word_index, bool rsp);
+
+// Check if a given rom range is valid CPU instructions
+bool check_range_cpu(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index);
 
 // // Check if a given CPU instruction is valid
 bool is_valid(const rabbitizer::InstructionCpu& instr);
@@ -63,12 +470,172 @@ bool is_valid(const rabbitizer::InstructionCpu& instr);
 bool is_valid_rsp(const rabbitizer::InstructionRsp& instr);
 
 // Check if a given rom range is valid RSP microcode
-bool check_range_rsp(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes);
+bool check_range_rsp(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index);
+
+// Checks if a rom range between two regions is valid CPU instructions
+using GapCheck = std::function<bool(size_t rom_start, size_t rom_end)>;
+
+// Find the jump tables used by the code in each region, merge regions that a jump table shows are parts of the same
+// function, and attach each table to the region containing the `jr` that uses it. Regions are only merged if
+// `gap_valid` accepts the gaps between them.
+void link_jump_tables(std::vector<RomRegion>& regions, size_t code_start, std::span<const uint8_t> rom_bytes,
+    const GapCheck& gap_valid);
+
+// Walk a region, collecting function starts, calls, returns and addresses built from HI/LO register pairs
+RegionReferences collect_region_references(const RomRegion& region, std::span<const uint8_t> rom_bytes);
+
+// Infer the vram address a region is loaded at from its jal targets and HI/LO register pairs
+void infer_region_vram(RomRegion& region, const RegionReferences& refs);
+
+// Build a call graph across all regions, mapping call targets to functions with each region's inferred vram address
+CallGraph build_call_graph(const std::vector<RomRegion>& regions);
 
 // Count the number of instructions at the beginning of a region with uninitialized register references
 size_t count_invalid_start_instructions(const RomRegion& region, std::span<const uint8_t> rom_bytes);
 
+// Run a linear def-use pass over a region, counting register usage that real code wouldn't have
+RegionDataflow analyze_region_dataflow(const RomRegion& region, std::span<const uint8_t> rom_bytes);
+
+// Turn the results of a def-use pass into a confidence score between 0 and 1
+float region_confidence(const RegionDataflow& dataflow);
+
+// Determine which `entropy_block_size` blocks of the rom could plausibly contain code
+std::vector<uint8_t> find_plausible_code_blocks(std::span<const uint8_t> rom_bytes);
+
 // Check if a given instruction outputs to $zero
 bool has_zero_output(const rabbitizer::InstructionCpu& instr);
 
+// Whether the scan phase probes record anything. Only set before scanning starts.
+extern bool scan_stats_enabled;
+
+// Allocations made by the current thread since it started
+AllocationCounters thread_allocation_counters();
+
+// Peak resident set size of the process in bytes, or 0 if it isn't available
+size_t peak_rss_bytes();
+
+// Whether the scan phase probes also record hardware performance counters. Only set before scanning starts.
+extern bool perf_counters_enabled;
+
+// Stats recorded by the probes running on the current thread
+ScanStats& thread_scan_stats();
+
+// Read the current thread's hardware performance counters, opening them on first use.
+// Returns false if none of the counters are available, e.g. on platforms other than Linux.
+bool read_perf_counters(PerfCounterValues& values);
+
+// Check if a given hardware performance counter could be opened on any thread
+bool perf_counter_available(PerfCounter counter);
+
+// Why the hardware performance counters couldn't be opened, or an empty string if they could
+std::string_view perf_counters_error();
+
+const char* perf_counter_name(PerfCounter counter);
+
+// Add the current thread's stats to the process totals and reset them, for when a scanning thread finishes
+void merge_thread_scan_stats();
+
+// Merge the current thread's stats and return the process totals
+ScanStats collect_scan_stats();
+
+const char* scan_phase_name(ScanPhase phase);
+
+const char* reject_rule_name(RejectRule rule);
+
+// Print per-phase time and throughput
+void print_scan_stats(const ScanStats& stats);
+
+// Rules disabled on the current thread as a bitmask of `RejectRule`, only used if rule ablation is enabled
+extern thread_local uint64_t disabled_rules;
+
+// Check if a rule should be applied. Always true unless rule ablation is enabled.
+inline bool rule_enabled(RejectRule rule) {
+    if constexpr (rule_ablation) {
+        return ((disabled_rules >> static_cast<uint64_t>(rule)) & 1) == 0;
+    }
+    return true;
+}
+
+// Count a word checked by `is_valid` or `is_valid_rsp`. Compiles to nothing unless rule counters are enabled.
+inline void count_validity_check(bool rsp) {
+    if constexpr (rule_counters) {
+        ScanStats& stats = thread_scan_stats();
+        (rsp ? stats.rsp_checks : stats.cpu_checks)++;
+    }
+}
+
+// Reject a word, counting the rule that rejected it if rule counters are enabled
+inline bool reject_word(RejectRule rule) {
+    if constexpr (rule_counters) {
+        thread_scan_stats().rejections[static_cast<size_t>(rule)]++;
+    }
+    return false;
+}
+
+// Reject an instruction as the start of a region, counting the rule that rejected it if rule counters are enabled
+inline bool reject_start_instruction(RejectRule rule) {
+    if constexpr (rule_counters) {
+        thread_scan_stats().rejections[static_cast<size_t>(rule)]++;
+    }
+    return true;
+}
+
+// Probe that times a scan phase from construction to destruction, and does nothing unless stats are enabled
+class PhaseTimer {
+public:
+    explicit PhaseTimer(ScanPhase phase) : phase_(phase) {
+        if (scan_stats_enabled) {
+            if (perf_counters_enabled) {
+                read_perf_counters(start_counters_);
+            }
+            start_allocations_ = thread_allocation_counters();
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer() {
+        stop();
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    // End the phase before the probe goes out of scope
+    void stop() {
+        if (scan_stats_enabled && !stopped_) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            PhaseStats& stats = thread_scan_stats()[phase_];
+            PerfCounterValues end_counters{};
+            if (perf_counters_enabled && read_perf_counters(end_counters)) {
+                for (size_t i = 0; i < perf_counter_count; i++) {
+                    stats.counters[i] += end_counters[i] - start_counters_[i];
+                }
+            }
+            stats.nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            stats.calls++;
+            stats.bytes += bytes_;
+            stats.instructions += instructions_;
+            AllocationCounters end_allocations = thread_allocation_counters();
+            stats.allocations.count += end_allocations.count - start_allocations_.count;
+            stats.allocations.bytes += end_allocations.bytes - start_allocations_.bytes;
+        }
+        stopped_ = true;
+    }
+
+    // Record the amount of rom the phase covered and how many instructions it decoded
+    void add_work(size_t bytes, size_t instructions) {
+        bytes_ += bytes;
+        instructions_ += instructions;
+    }
+
+private:
+    ScanPhase phase_;
+    std::chrono::steady_clock::time_point start_{};
+    PerfCounterValues start_counters_{};
+    AllocationCounters start_allocations_{};
+    size_t bytes_ = 0;
+    size_t instructions_ = 0;
+    bool stopped_ = false;
+};
+
 #endif
@@ -0,0 +1,92 @@
+#include <cstdlib>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "findcode.h"
+
+// Counting replacements for the global allocation functions, so scans can report how much they allocate.
+// Only built with `ALLOC_COUNTERS=1`, so normal builds keep the default allocator.
+thread_local AllocationCounters current_thread_allocations{};
+
+#ifdef FINDCODE_ALLOC_COUNTERS
+
+void count_allocation(size_t size) {
+    current_thread_allocations.count++;
+    current_thread_allocations.bytes += size;
+}
+
+void* operator new(size_t size) {
+    count_allocation(size);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    count_allocation(size);
+    size_t align = static_cast<size_t>(alignment);
+#ifdef _MSC_VER
+    void* ptr = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    // aligned_alloc requires the size to be a multiple of the alignment
+    void* ptr = std::aligned_alloc(align, (size + align) / align * align);
+#endif
+    if (ptr != nullptr) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+#ifdef _MSC_VER
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    _aligned_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    _aligned_free(ptr);
+}
+#else
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+#endif
+#endif
+
+// Allocations made by the current thread since it started, which are always zero unless allocation counters are enabled
+AllocationCounters thread_allocation_counters() {
+    return current_thread_allocations;
+}
+
+// Peak resident set size of the process in bytes, or 0 if it isn't available
+size_t peak_rss_bytes() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // Reported in bytes on macOS and kilobytes everywhere else
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
@@ -1,165 +1,231 @@
 #include <array>
+#include <atomic>
+#include <bit>
 
 #include "rabbitizer.hpp"
 #include "fmt/format.h"
 
 #include "findcode.h"
 
-struct RegisterState {
-    bool initialized;
-};
+// One bit per register index, used to track register state for all 32 GPRs or FPRs at once
+using RegisterMask = uint32_t;
+
+constexpr RegisterMask gpr_bit(RegisterId reg) {
+    return RegisterMask{1} << static_cast<uint32_t>(reg);
+}
 
-using GprRegisterStates = std::array<RegisterState, 32>;
-using FprRegisterStates = std::array<RegisterState, 32>;
+constexpr RegisterMask fpr_bit(FprRegisterId reg) {
+    return RegisterMask{1} << static_cast<uint32_t>(reg);
+}
 
 // Treat $v0 and $fv0 as an initialized register
 // gcc will use these for the first uninitialized variable reference for ints and floats respectively,
 // so enabling this option won't reject gcc functions that begin with a reference to an uninitialized local variable.
 constexpr bool weak_uninitialized_check = true;
 
-// Checks if an instruction has the given operand as an input
-bool has_operand_input(const rabbitizer::InstructionCpu& instr, rabbitizer::OperandType operand) {
-    InstrId id = instr.getUniqueId();
-
-    // If the instruction has the given operand and doesn't modify it, then it's an input
-    if (instr.hasOperandAlias(operand)) {
-        switch (operand) {
-            case rabbitizer::OperandType::cpu_rd:
-                return !instr.modifiesRd();
-            case rabbitizer::OperandType::cpu_rt:
-                return !instr.modifiesRt();
-            case rabbitizer::OperandType::cpu_rs:
-                // rs is always an input
-                return true;
-            case rabbitizer::OperandType::cpu_fd:
-                // fd is never an input
-                return false;
-            case rabbitizer::OperandType::cpu_ft:
-                // ft is always an input except for lwc1 and ldc1
-                return (id != InstrId::cpu_lwc1 && id != InstrId::cpu_ldc1);
-            case rabbitizer::OperandType::cpu_fs:
-                // fs is always an input, except for mtc1 and dmtc1
-                return (id != InstrId::cpu_mtc1 && id != InstrId::cpu_dmtc1);
-            default:
-                return false;
-        }
-    }
-    return false;
-}
-
-// Check if an instruction outputs to $zero
-bool has_zero_output(const rabbitizer::InstructionCpu& instr) {
-    return static_cast<RegisterId>(instr.getDestinationGpr()) == RegisterId::GPR_O32_zero;
-}
+// GPRs that are considered initialized at the start of a function
+constexpr RegisterMask entry_gpr_mask =
+    // Zero is always initialized (it's zero)
+    gpr_bit(RegisterId::GPR_O32_zero) |
+    // The stack pointer and return address always initialized
+    gpr_bit(RegisterId::GPR_O32_sp) | gpr_bit(RegisterId::GPR_O32_ra) |
+    // Treat all arg registers as initialized
+    gpr_bit(RegisterId::GPR_O32_a0) | gpr_bit(RegisterId::GPR_O32_a1) |
+    gpr_bit(RegisterId::GPR_O32_a2) | gpr_bit(RegisterId::GPR_O32_a3) |
+    // Treat $v0 as initialized for gcc if enabled
+    (weak_uninitialized_check ? gpr_bit(RegisterId::GPR_O32_v0) : 0);
 
-// Checks if an instruction references an uninitialized register
-bool references_uninitialized(const rabbitizer::InstructionCpu& instr, const GprRegisterStates& gpr_reg_states, const FprRegisterStates& fpr_reg_states) {
-    bool ret = false;
+// FPRs that are considered initialized at the start of a function
+constexpr RegisterMask entry_fpr_mask =
+    // Treat all arg registers as initialized
+    fpr_bit(FprRegisterId::COP1_O32_fa0) | fpr_bit(FprRegisterId::COP1_O32_fa0f) |
+    fpr_bit(FprRegisterId::COP1_O32_fa1) | fpr_bit(FprRegisterId::COP1_O32_fa1f) |
+    // Treat $fv0 as initialized for gcc if enabled
+    (weak_uninitialized_check ? (fpr_bit(FprRegisterId::COP1_O32_fv0) | fpr_bit(FprRegisterId::COP1_O32_fv0f)) : 0);
+
+// How an instruction uses each of its register operands. This only depends on the instruction's unique id,
+// so it's computed once per id and cached.
+enum OperandRole : uint16_t {
+    rs_input   = 1 << 0,
+    rt_input   = 1 << 1,
+    rt_output  = 1 << 2,
+    rd_input   = 1 << 3,
+    rd_output  = 1 << 4,
+    fs_input   = 1 << 5,
+    fs_output  = 1 << 6,
+    ft_input   = 1 << 7,
+    ft_output  = 1 << 8,
+    fd_output  = 1 << 9,
+    // Marks a cache entry as filled in
+    roles_computed = 1 << 15,
+};
 
-    // Retrieve all of the possible operand registers
-    int rs = (int)instr.GetO32_rs();
-    int rd = (int)instr.GetO32_rd();
-    int rt = (int)instr.GetO32_rt();
+// Determines the operand roles for an instruction
+uint16_t compute_operand_roles(const rabbitizer::InstructionCpu& instr) {
+    InstrId id = instr.getUniqueId();
+    uint16_t roles = roles_computed;
 
-    int fs = (int)instr.GetO32_fs();
-    int fd = (int)instr.GetO32_fd();
-    int ft = (int)instr.GetO32_ft();
+    // rs is always an input
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_rs)) {
+        roles |= rs_input;
+    }
 
-    // For each operand type, check if the instruction uses that operand as an input and whether the corresponding register is initialized
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_rs) && !gpr_reg_states[rs].initialized) {
-        ret = true;
+    // rt and rd are inputs unless the instruction modifies them
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_rt)) {
+        roles |= instr.modifiesRt() ? rt_output : rt_input;
     }
 
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_rd) && !gpr_reg_states[rd].initialized) {
-        ret = true;
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_rd)) {
+        roles |= instr.modifiesRd() ? rd_output : rd_input;
     }
 
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_rt) && !gpr_reg_states[rt].initialized) {
-        ret = true;
+    // fs is always an input, except for mtc1 and dmtc1
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_fs)) {
+        roles |= (id == InstrId::cpu_mtc1 || id == InstrId::cpu_dmtc1) ? fs_output : fs_input;
     }
 
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_fs) && !fpr_reg_states[fs].initialized) {
-        ret = true;
+    // ft is always an input except for lwc1 and ldc1
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_ft)) {
+        roles |= (id == InstrId::cpu_lwc1 || id == InstrId::cpu_ldc1) ? ft_output : ft_input;
     }
 
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_fd) && !fpr_reg_states[fd].initialized) {
-        ret = true;
+    // fd is never an input
+    if (instr.hasOperandAlias(rabbitizer::OperandType::cpu_fd)) {
+        roles |= fd_output;
     }
 
-    if (has_operand_input(instr, rabbitizer::OperandType::cpu_ft) && !fpr_reg_states[ft].initialized) {
-        ret = true;
+    return roles;
+}
+
+// Per unique id cache of operand roles. Entries are filled in lazily and the result for a given id is always the same,
+// so relaxed atomics are enough to make this safe to share between threads.
+std::array<std::atomic<uint16_t>, static_cast<size_t>(InstrId::ALL_MAX)> operand_role_cache{};
+
+uint16_t get_operand_roles(const rabbitizer::InstructionCpu& instr) {
+    size_t index = static_cast<size_t>(instr.getUniqueId());
+    uint16_t roles = operand_role_cache[index].load(std::memory_order_relaxed);
+
+    if (roles == 0) {
+        roles = compute_operand_roles(instr);
+        operand_role_cache[index].store(roles, std::memory_order_relaxed);
     }
 
-    return ret;
+    return roles;
+}
+
+// The registers an instruction reads and writes
+struct RegisterUsage {
+    RegisterMask gpr_inputs;
+    RegisterMask gpr_outputs;
+    RegisterMask fpr_inputs;
+    RegisterMask fpr_outputs;
+};
+
+// Builds the register input and output masks for an instruction from its cached operand roles
+RegisterUsage get_register_usage(const rabbitizer::InstructionCpu& instr) {
+    uint16_t roles = get_operand_roles(instr);
+
+    // Retrieve all of the possible operand registers as single-bit masks
+    RegisterMask rs = gpr_bit(instr.GetO32_rs());
+    RegisterMask rt = gpr_bit(instr.GetO32_rt());
+    RegisterMask rd = gpr_bit(instr.GetO32_rd());
+
+    RegisterMask fs = fpr_bit(instr.GetO32_fs());
+    RegisterMask ft = fpr_bit(instr.GetO32_ft());
+    RegisterMask fd = fpr_bit(instr.GetO32_fd());
+
+    // Select each operand's bit into the input or output mask depending on its role
+    auto select = [roles](uint16_t role, RegisterMask mask) {
+        return (roles & role) ? mask : 0;
+    };
+
+    return RegisterUsage{
+        .gpr_inputs  = select(rs_input, rs) | select(rt_input, rt) | select(rd_input, rd),
+        .gpr_outputs = select(rt_output, rt) | select(rd_output, rd),
+        .fpr_inputs  = select(fs_input, fs) | select(ft_input, ft),
+        .fpr_outputs = select(fs_output, fs) | select(ft_output, ft) | select(fd_output, fd),
+    };
+}
+
+// Check if an instruction outputs to $zero
+bool has_zero_output(const rabbitizer::InstructionCpu& instr) {
+    return static_cast<RegisterId>(instr.getDestinationGpr()) == RegisterId::GPR_O32_zero;
+}
+
+// Checks if an instruction references an uninitialized register
+bool references_uninitialized(const rabbitizer::InstructionCpu& instr, RegisterMask gpr_initialized, RegisterMask fpr_initialized) {
+    RegisterUsage usage = get_register_usage(instr);
+
+    return ((usage.gpr_inputs & ~gpr_initialized) | (usage.fpr_inputs & ~fpr_initialized)) != 0;
 }
 
 // Check if this instruction is (probably) invalid when at the beginning of a region of code
-bool is_invalid_start_instruction(const rabbitizer::InstructionCpu& instr, const GprRegisterStates& gpr_reg_states, const FprRegisterStates& fpr_reg_states) {
+bool is_invalid_start_instruction(const rabbitizer::InstructionCpu& instr, RegisterMask gpr_initialized, RegisterMask fpr_initialized) {
     InstrId id = instr.getUniqueId();
 
     // Code probably won't start with a nop (some functions do, but it'll just be one nop that can be recovered later)
-    if (id == InstrId::cpu_nop) {
-        return true;
+    if (rule_enabled(RejectRule::start_nop) && id == InstrId::cpu_nop) {
+        return reject_start_instruction(RejectRule::start_nop);
     }
 
     // Check if this is a valid instruction to begin with
-    if (!is_valid(instr)) {
-        return true;
+    if (rule_enabled(RejectRule::start_invalid) && !is_valid(instr)) {
+        return reject_start_instruction(RejectRule::start_invalid);
     }
     
     // Code shouldn't output to $zero
-    if (has_zero_output(instr)) {
-        return true;
+    if (rule_enabled(RejectRule::start_zero_output) && has_zero_output(instr)) {
+        return reject_start_instruction(RejectRule::start_zero_output);
     }
     
     // Code shouldn't start with a reference to a register that isn't initialized
-    if (references_uninitialized(instr, gpr_reg_states, fpr_reg_states)) {
-        return true;
+    if (rule_enabled(RejectRule::start_uninitialized_read) && references_uninitialized(instr, gpr_initialized, fpr_initialized)) {
+        return reject_start_instruction(RejectRule::start_uninitialized_read);
     }
 
     // Code shouldn't start with an unconditional branch
-    if (id == InstrId::cpu_b || id == InstrId::cpu_j) {
-        return true;
+    if (rule_enabled(RejectRule::start_unconditional_branch) && (id == InstrId::cpu_b || id == InstrId::cpu_j)) {
+        return reject_start_instruction(RejectRule::start_unconditional_branch);
     }
 
     // Code shouldn't start with a linked jump, as it'd need to save the return address first
-    if (id == InstrId::cpu_jal || id == InstrId::cpu_jalr) {
-        return true;
+    if (rule_enabled(RejectRule::start_linked_jump) && (id == InstrId::cpu_jal || id == InstrId::cpu_jalr)) {
+        return reject_start_instruction(RejectRule::start_linked_jump);
     }
 
     // Code shouldn't jump to $zero
-    if (id == InstrId::cpu_jr && instr.GetO32_rs() == RegisterId::GPR_O32_zero) {
-        return true;
+    if (rule_enabled(RejectRule::start_jr_zero) && id == InstrId::cpu_jr && instr.GetO32_rs() == RegisterId::GPR_O32_zero) {
+        return reject_start_instruction(RejectRule::start_jr_zero);
     }
 
     // Shifts with $zero as the input and a non-zero shift amount are likely not real code
-    if (id == InstrId::cpu_sll || id == InstrId::cpu_srl || id == InstrId::cpu_sra ||
+    if (rule_enabled(RejectRule::start_zero_shift) && (id == InstrId::cpu_sll || id == InstrId::cpu_srl || id == InstrId::cpu_sra ||
         id == InstrId::cpu_dsll || id == InstrId::cpu_dsll32 || id == InstrId::cpu_dsrl ||
-        id == InstrId::cpu_dsrl32 || id == InstrId::cpu_dsra || id == InstrId::cpu_dsra32) {
+        id == InstrId::cpu_dsrl32 || id == InstrId::cpu_dsra || id == InstrId::cpu_dsra32)) {
         // fmt::print("test {} {} {}\n", (int)id, (int)instr.GetO32_rt(), instr.Get_sa());
         if (instr.GetO32_rt() == RegisterId::GPR_O32_zero && instr.Get_sa() != 0) {
-            return true;
+            return reject_start_instruction(RejectRule::start_zero_shift);
         }
     }
 
     // Code probably won't start with mthi or mtlo
-    if (id == InstrId::cpu_mthi || id == InstrId::cpu_mtlo) {
-        return true;
+    if (rule_enabled(RejectRule::start_mthi_mtlo) && (id == InstrId::cpu_mthi || id == InstrId::cpu_mtlo)) {
+        return reject_start_instruction(RejectRule::start_mthi_mtlo);
     }
     
     // Code shouldn't start with branches based on the cop1 condition flag (it won't have been set yet)
-    if (id == InstrId::cpu_bc1t || id == InstrId::cpu_bc1f || id == InstrId::cpu_bc1tl || id == InstrId::cpu_bc1fl) {
-        return true;
+    if (rule_enabled(RejectRule::start_cop1_branch) && (id == InstrId::cpu_bc1t || id == InstrId::cpu_bc1f || id == InstrId::cpu_bc1tl || id == InstrId::cpu_bc1fl)) {
+        return reject_start_instruction(RejectRule::start_cop1_branch);
     }
 
     // add/sub and addi are good indicators that the bytes aren't actually instructions, since addu/subu and addiu would normally be used
-    if (id == InstrId::cpu_add || id == InstrId::cpu_sub || id == InstrId::cpu_addi) {
-        return true;
+    if (rule_enabled(RejectRule::start_trapping_arithmetic) && (id == InstrId::cpu_add || id == InstrId::cpu_sub || id == InstrId::cpu_addi)) {
+        return reject_start_instruction(RejectRule::start_trapping_arithmetic);
     }
 
     // Code shouldn't start with a store relative to $ra
-    if (instr.hasOperand(rabbitizer::OperandType::cpu_immediate_base) && instr.GetO32_rs() == RegisterId::GPR_O32_ra) {
-        return true;
+    if (rule_enabled(RejectRule::start_ra_base) && instr.hasOperand(rabbitizer::OperandType::cpu_immediate_base) && instr.GetO32_rs() == RegisterId::GPR_O32_ra) {
+        return reject_start_instruction(RejectRule::start_ra_base);
     }
 
     return false;
@@ -167,55 +233,151 @@ bool is_invalid_start_instruction(const rabbitizer::InstructionCpu& instr, const
 
 // Count the number of instructions at the beginning of a region with uninitialized register references
 size_t count_invalid_start_instructions(const RomRegion& region, std::span<const uint8_t> rom_bytes) {
-    GprRegisterStates gpr_reg_states{};
-    FprRegisterStates fpr_reg_states{};
-
-    // GPRs
-    
-    // Zero is always initialized (it's zero)
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_zero].initialized = true;
+    size_t instr_index = 0;
 
-    // The stack pointer and return address always initialized
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_sp].initialized = true;
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_ra].initialized = true;
+    while (true) {
+        uint32_t instr_word = read32(rom_bytes, instruction_size * instr_index + region.rom_start);
+        rabbitizer::InstructionCpu instr{instr_word, 0};
 
-    // Treat all arg registers as initialized
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_a0].initialized = true;
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_a1].initialized = true;
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_a2].initialized = true;
-    gpr_reg_states[(size_t)RegisterId::GPR_O32_a3].initialized = true;
+        if (!is_invalid_start_instruction(instr, entry_gpr_mask, entry_fpr_mask)) {
+            break;
+        }
 
-    // Treat $v0 as initialized for gcc if enabled
-    if (weak_uninitialized_check) {
-        gpr_reg_states[(size_t)RegisterId::GPR_O32_v0].initialized = true;
+        instr_index++;
     }
-    
-    // FPRs
 
-    // Treat all arg registers as initialized
-    fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fa0];
-    fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fa0f];
-    fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fa1];
-    fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fa1f];
+    return instr_index;
+}
 
-    // Treat $fv0 as initialized for gcc if enabled
-    if (weak_uninitialized_check) {
-        fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fv0];
-        fpr_reg_states[(size_t)FprRegisterId::COP1_O32_fv0f];
+// Weights of each kind of anomaly when computing a region's confidence score
+// Unread writes are weighted lowest as the linear pass doesn't follow branches, so writes on both sides of an if/else
+// look like one overwriting the other.
+constexpr float uninitialized_read_weight = 1.0f;
+constexpr float unread_write_weight = 0.25f;
+constexpr float stack_pointer_misuse_weight = 2.0f;
+// How quickly the confidence score drops as the anomaly rate increases
+constexpr float confidence_falloff = 8.0f;
+
+// GPRs that a called function may read (the argument registers)
+constexpr RegisterMask call_gpr_inputs =
+    gpr_bit(RegisterId::GPR_O32_a0) | gpr_bit(RegisterId::GPR_O32_a1) |
+    gpr_bit(RegisterId::GPR_O32_a2) | gpr_bit(RegisterId::GPR_O32_a3);
+
+// FPRs that a called function may read (the argument registers)
+constexpr RegisterMask call_fpr_inputs =
+    fpr_bit(FprRegisterId::COP1_O32_fa0) | fpr_bit(FprRegisterId::COP1_O32_fa0f) |
+    fpr_bit(FprRegisterId::COP1_O32_fa1) | fpr_bit(FprRegisterId::COP1_O32_fa1f);
+
+// GPRs that a called function writes (the return value registers)
+constexpr RegisterMask call_gpr_outputs = gpr_bit(RegisterId::GPR_O32_v0) | gpr_bit(RegisterId::GPR_O32_v1);
+
+// FPRs that a called function writes (the return value registers)
+constexpr RegisterMask call_fpr_outputs = fpr_bit(FprRegisterId::COP1_O32_fv0) | fpr_bit(FprRegisterId::COP1_O32_fv0f);
+
+// Check if an instruction that writes to $sp is a normal stack pointer adjustment
+bool is_stack_pointer_adjustment(const rabbitizer::InstructionCpu& instr, const RegisterUsage& usage) {
+    InstrId id = instr.getUniqueId();
+
+    // Stack frames are allocated and freed with an addiu of a multiple of 8
+    if (id == InstrId::cpu_addiu) {
+        int16_t imm = static_cast<int16_t>(instr.getRaw() & 0xFFFF);
+        return instr.GetO32_rs() == RegisterId::GPR_O32_sp && (imm % 8) == 0;
     }
 
-    size_t instr_index = 0;
+    // Large stack frames use a register for the adjustment, and functions with a frame pointer restore $sp from it
+    return (usage.gpr_inputs & (gpr_bit(RegisterId::GPR_O32_sp) | gpr_bit(RegisterId::GPR_O32_fp))) != 0;
+}
 
-    while (true) {
-        uint32_t instr_word = read32(rom_bytes, instruction_size * instr_index + region.rom_start);
-        rabbitizer::InstructionCpu instr{instr_word, 0};
+// Run a linear def-use pass over a region, counting register usage that real code wouldn't have
+RegionDataflow analyze_region_dataflow(const RomRegion& region, std::span<const uint8_t> rom_bytes) {
+    RegionDataflow ret{};
+
+    // Registers that have been written (or are assumed to be initialized)
+    RegisterMask gpr_written = entry_gpr_mask;
+    RegisterMask fpr_written = entry_fpr_mask;
+    // Registers that have been written but not read since
+    RegisterMask gpr_pending = 0;
+    RegisterMask fpr_pending = 0;
+    // Whether the previous instruction was a `jr $ra`, meaning the current one is the last in the function
+    bool prev_was_return = false;
+
+    for (size_t offset = region.rom_start; offset < region.rom_end; offset += instruction_size) {
+        rabbitizer::InstructionCpu instr{read32(rom_bytes, offset), 0};
+
+        if (!is_valid(instr)) {
+            // Regions with microcode stop being CPU code at the first invalid instruction
+            if (region.has_rsp) {
+                break;
+            }
+            continue;
+        }
 
-        if (!is_invalid_start_instruction(instr, gpr_reg_states, fpr_reg_states)) {
-            break;
+        ret.instruction_count++;
+
+        RegisterUsage usage = get_register_usage(instr);
+        InstrId id = instr.getUniqueId();
+
+        // Count each register that gets read without being written once, then treat it as initialized
+        ret.uninitialized_reads += std::popcount(usage.gpr_inputs & ~gpr_written);
+        ret.uninitialized_reads += std::popcount(usage.fpr_inputs & ~fpr_written);
+        gpr_written |= usage.gpr_inputs;
+        fpr_written |= usage.fpr_inputs;
+        gpr_pending &= ~usage.gpr_inputs;
+        fpr_pending &= ~usage.fpr_inputs;
+
+        // Function calls read the argument registers and write the return value registers
+        if (instr.doesLink()) {
+            gpr_pending &= ~call_gpr_inputs;
+            fpr_pending &= ~call_fpr_inputs;
+            usage.gpr_outputs |= call_gpr_outputs;
+            usage.fpr_outputs |= call_fpr_outputs;
         }
 
-        instr_index++;
+        // Count writes that replace a value that was never read
+        ret.unread_writes += std::popcount(usage.gpr_outputs & gpr_pending);
+        ret.unread_writes += std::popcount(usage.fpr_outputs & fpr_pending);
+        gpr_written |= usage.gpr_outputs;
+        fpr_written |= usage.fpr_outputs;
+        // Writes to $zero are discarded, so they're never pending
+        gpr_pending |= usage.gpr_outputs & ~gpr_bit(RegisterId::GPR_O32_zero);
+        fpr_pending |= usage.fpr_outputs;
+
+        // Check for writes to $sp that aren't stack frame adjustments
+        if ((usage.gpr_outputs & gpr_bit(RegisterId::GPR_O32_sp)) && !is_stack_pointer_adjustment(instr, usage)) {
+            ret.stack_pointer_misuse++;
+        }
+
+        // Check for memory accesses below the stack pointer, which would be outside of the stack frame
+        if ((instr.doesLoad() || instr.doesStore()) && instr.GetO32_rs() == RegisterId::GPR_O32_sp &&
+            static_cast<int16_t>(instr.getRaw() & 0xFFFF) < 0) {
+            ret.stack_pointer_misuse++;
+        }
+
+        // Reset the register state once the delay slot of a return has been processed, as a new function follows
+        if (prev_was_return) {
+            gpr_written = entry_gpr_mask;
+            fpr_written = entry_fpr_mask;
+            gpr_pending = 0;
+            fpr_pending = 0;
+        }
+
+        prev_was_return = id == InstrId::cpu_jr && instr.GetO32_rs() == RegisterId::GPR_O32_ra;
     }
 
-    return instr_index;
+    return ret;
+}
+
+// Turn the results of a def-use pass into a confidence score between 0 and 1
+float region_confidence(const RegionDataflow& dataflow) {
+    if (dataflow.instruction_count == 0) {
+        return 0.0f;
+    }
+
+    float weighted_anomalies =
+        uninitialized_read_weight * static_cast<float>(dataflow.uninitialized_reads) +
+        unread_write_weight * static_cast<float>(dataflow.unread_writes) +
+        stack_pointer_misuse_weight * static_cast<float>(dataflow.stack_pointer_misuse);
+    float anomaly_rate = weighted_anomalies / static_cast<float>(dataflow.instruction_count);
+
+    return 1.0f / (1.0f + confidence_falloff * anomaly_rate);
 }
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "findcode.h"
+
+// A region's vram range, used to map call targets back to rom addresses
+struct VramMapping {
+    uint32_t vram_start;
+    uint32_t vram_end;
+    size_t rom_start;
+    size_t region_index;
+};
+
+// Build a call graph across all regions, mapping call targets to functions with each region's inferred vram address
+CallGraph build_call_graph(const std::vector<RomRegion>& regions) {
+    CallGraph ret{};
+    ret.unresolved_calls = 0;
+    ret.ambiguous_calls = 0;
+
+    // Concatenate every region's function list, using the references collected during the scan
+    // Regions are sorted by rom address, so the combined function list is too.
+    for (const RomRegion& region : regions) {
+        const RegionReferences& refs = region.references;
+        ret.function_starts.insert(ret.function_starts.end(), refs.function_starts.begin(), refs.function_starts.end());
+        ret.return_counts.insert(ret.return_counts.end(), refs.return_counts.begin(), refs.return_counts.end());
+    }
+
+    std::vector<VramMapping> mappings{};
+    uint32_t max_mapping_size = 0;
+    for (size_t region_index = 0; region_index < regions.size(); region_index++) {
+        const RomRegion& region = regions[region_index];
+        if (region.vram != 0) {
+            uint32_t size = static_cast<uint32_t>(region.rom_end - region.rom_start);
+            mappings.push_back(VramMapping{
+                .vram_start = region.vram,
+                .vram_end = region.vram + size,
+                .rom_start = region.rom_start,
+                .region_index = region_index,
+            });
+            max_mapping_size = std::max(max_mapping_size, size);
+        }
+    }
+    std::sort(mappings.begin(), mappings.end(), [](const VramMapping& a, const VramMapping& b) { return a.vram_start < b.vram_start; });
+
+    // Map a call target to a function index within one mapping, returning the function count if it isn't a function start
+    size_t function_count = ret.function_starts.size();
+    auto resolve_in_mapping = [&](const VramMapping& mapping, uint32_t target) {
+        if (target < mapping.vram_start || target >= mapping.vram_end) {
+            return function_count;
+        }
+        size_t target_rom = mapping.rom_start + (target - mapping.vram_start);
+        auto function = std::lower_bound(ret.function_starts.begin(), ret.function_starts.end(), target_rom);
+        if (function == ret.function_starts.end() || *function != target_rom) {
+            return function_count;
+        }
+        return static_cast<size_t>(function - ret.function_starts.begin());
+    };
+
+    // Each region's mapping, if it has one, so a call can be resolved within the caller's own region first
+    std::vector<const VramMapping*> region_mappings(regions.size(), nullptr);
+    for (const VramMapping& mapping : mappings) {
+        region_mappings[mapping.region_index] = &mapping;
+    }
+
+    // Map a call target to a function index, returning the function count if it doesn't land on exactly one function.
+    // Overlays share vram ranges, so a target in the caller's own region wins, and otherwise a target that's a function
+    // start in more than one region is ambiguous.
+    bool ambiguous = false;
+    auto resolve_target = [&](size_t caller_region, uint32_t target) {
+        ambiguous = false;
+        if (const VramMapping* own = region_mappings[caller_region]) {
+            size_t function = resolve_in_mapping(*own, target);
+            if (function != function_count) {
+                return function;
+            }
+        }
+
+        // Every mapping starting within `max_mapping_size` before the target could cover it
+        size_t ret_function = function_count;
+        auto mapping = std::upper_bound(mappings.begin(), mappings.end(), target,
+            [](uint32_t vram, const VramMapping& m) { return vram < m.vram_start; });
+        while (mapping != mappings.begin()) {
+            --mapping;
+            if (target - mapping->vram_start >= max_mapping_size) {
+                break;
+            }
+            size_t function = resolve_in_mapping(*mapping, target);
+            if (function != function_count && function != ret_function) {
+                if (ret_function != function_count) {
+                    ambiguous = true;
+                    return function_count;
+                }
+                ret_function = function;
+            }
+        }
+        return ret_function;
+    };
+
+    // Calls are collected in function order, so the rows can be filled in directly
+    ret.call_offsets.reserve(function_count + 1);
+    ret.call_offsets.push_back(0);
+    for (size_t region_index = 0; region_index < regions.size(); region_index++) {
+        const RegionReferences& refs = regions[region_index].references;
+        size_t call_index = 0;
+
+        for (size_t local_function = 0; local_function < refs.function_starts.size(); local_function++) {
+            size_t row_start = ret.callees.size();
+            for (; call_index < refs.calls.size() && refs.calls[call_index].caller == local_function; call_index++) {
+                size_t callee = resolve_target(region_index, refs.calls[call_index].target);
+                if (ambiguous) {
+                    ret.ambiguous_calls++;
+                } else if (callee == function_count) {
+                    ret.unresolved_calls++;
+                } else {
+                    ret.callees.push_back(static_cast<uint32_t>(callee));
+                }
+            }
+
+            // Remove duplicate calls from the row
+            std::sort(ret.callees.begin() + row_start, ret.callees.end());
+            ret.callees.erase(std::unique(ret.callees.begin() + row_start, ret.callees.end()), ret.callees.end());
+            ret.call_offsets.push_back(static_cast<uint32_t>(ret.callees.size()));
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+
+// Compressed blocks claiming to decompress to more than this are assumed to be false positives
+constexpr size_t max_decompressed_size = 64 * 1024 * 1024;
+// Compressed blocks smaller than this can't contain a meaningful amount of code
+constexpr size_t min_decompressed_size = min_region_instructions * instruction_size;
+// Size of the header common to all of the supported formats (magic, decompressed size, two offsets or padding)
+constexpr size_t compression_header_size = 0x10;
+// Number of words of invalid instructions appended after decompressed data, so that searches that don't check for the
+// end of their buffer stop before running off it
+constexpr size_t scratch_guard_words = 2;
+// An instruction word with a reserved primary opcode, which is never valid
+constexpr uint32_t scratch_guard_word = 0x7C000000;
+
+// Get the format for a magic word, if it's one of the supported compression formats
+std::optional<CompressionFormat> compression_format_from_magic(uint32_t word) {
+    switch (word) {
+        case 0x59617930: // Yay0
+            return CompressionFormat::Yay0;
+        case 0x59617A30: // Yaz0
+            return CompressionFormat::Yaz0;
+        case 0x4D494F30: // MIO0
+            return CompressionFormat::MIO0;
+        default:
+            return std::nullopt;
+    }
+}
+
+const char* compression_format_name(CompressionFormat format) {
+    switch (format) {
+        case CompressionFormat::Yay0:
+            return "Yay0";
+        case CompressionFormat::Yaz0:
+            return "Yaz0";
+        case CompressionFormat::MIO0:
+            return "MIO0";
+    }
+    return "unknown";
+}
+
+// Check if a word is the start of a compressed block and record it if so
+void check_compression_header(std::span<const uint8_t> rom_bytes, size_t rom_addr, std::vector<CompressedBlock>& compressed_blocks) {
+    std::optional<CompressionFormat> format = compression_format_from_magic(read32(rom_bytes, rom_addr));
+    if (!format.has_value() || rom_addr + compression_header_size > rom_bytes.size()) {
+        return;
+    }
+
+    // Reject headers with implausible decompressed sizes, as the magic may just be data that happens to match
+    size_t decompressed_size = read32(rom_bytes, rom_addr + 4);
+    if (decompressed_size < min_decompressed_size || decompressed_size > max_decompressed_size) {
+        return;
+    }
+
+    compressed_blocks.push_back(CompressedBlock{
+        .rom_offset = rom_addr,
+        .format = format.value(),
+        .decompressed_size = decompressed_size,
+    });
+}
+
+// Bounds checked reader of a big-endian byte stream within a compressed block
+class CompressedReader {
+public:
+    CompressedReader(std::span<const uint8_t> rom_bytes, size_t block_start, size_t offset) :
+        rom_bytes_(rom_bytes), pos_(block_start + offset), failed_(false) {}
+
+    uint8_t u8() {
+        if (pos_ >= rom_bytes_.size()) {
+            failed_ = true;
+            return 0;
+        }
+        return read8_be(rom_bytes_, pos_++);
+    }
+
+    uint16_t u16() {
+        uint16_t high = u8();
+        return static_cast<uint16_t>((high << 8) | u8());
+    }
+
+    bool failed() const {
+        return failed_;
+    }
+
+private:
+    std::span<const uint8_t> rom_bytes_;
+    size_t pos_;
+    bool failed_;
+};
+
+// Reads control bits MSB-first from a byte stream
+class ControlBitReader {
+public:
+    explicit ControlBitReader(CompressedReader& reader) : reader_(reader), bits_(0), remaining_(0) {}
+
+    bool next() {
+        if (remaining_ == 0) {
+            bits_ = reader_.u8();
+            remaining_ = 8;
+        }
+        remaining_--;
+        return (bits_ >> remaining_) & 1;
+    }
+
+private:
+    CompressedReader& reader_;
+    uint8_t bits_;
+    int remaining_;
+};
+
+// Copies `length` bytes from `distance` bytes back in the output, returning false if that's out of bounds
+bool copy_backreference(std::vector<uint8_t>& out, size_t distance, size_t length, size_t decompressed_size) {
+    if (distance > out.size() || out.size() + length > decompressed_size) {
+        return false;
+    }
+    // Byte by byte, since the source may overlap the bytes being written
+    size_t source = out.size() - distance;
+    for (size_t i = 0; i < length; i++) {
+        out.push_back(out[source + i]);
+    }
+    return true;
+}
+
+// Decompress a Yaz0 block, where control bytes, literals and backreferences are interleaved in one stream
+bool decompress_yaz0(std::span<const uint8_t> rom_bytes, const CompressedBlock& block, std::vector<uint8_t>& out) {
+    CompressedReader data{rom_bytes, block.rom_offset, compression_header_size};
+    ControlBitReader control{data};
+
+    while (out.size() < block.decompressed_size && !data.failed()) {
+        if (control.next()) {
+            out.push_back(data.u8());
+        } else {
+            uint8_t byte1 = data.u8();
+            uint8_t byte2 = data.u8();
+            size_t distance = (((byte1 & 0xF) << 8) | byte2) + 1;
+            size_t length = byte1 >> 4;
+            length = (length == 0) ? data.u8() + 0x12 : length + 2;
+            if (!copy_backreference(out, distance, length, block.decompressed_size)) {
+                return false;
+            }
+        }
+    }
+
+    return !data.failed();
+}
+
+// Decompress a Yay0 or MIO0 block, which both keep the control bits, backreferences and literals in separate streams
+bool decompress_yay0_mio0(std::span<const uint8_t> rom_bytes, const CompressedBlock& block, std::vector<uint8_t>& out) {
+    size_t link_offset = read32(rom_bytes, block.rom_offset + 0x8);
+    size_t literal_offset = read32(rom_bytes, block.rom_offset + 0xC);
+    if (link_offset < compression_header_size || literal_offset < compression_header_size) {
+        return false;
+    }
+
+    CompressedReader control_data{rom_bytes, block.rom_offset, compression_header_size};
+    CompressedReader links{rom_bytes, block.rom_offset, link_offset};
+    CompressedReader literals{rom_bytes, block.rom_offset, literal_offset};
+    ControlBitReader control{control_data};
+
+    while (out.size() < block.decompressed_size && !control_data.failed() && !links.failed() && !literals.failed()) {
+        if (control.next()) {
+            out.push_back(literals.u8());
+        } else {
+            uint16_t link = links.u16();
+            size_t distance = (link & 0xFFF) + 1;
+            size_t length = link >> 12;
+            if (block.format == CompressionFormat::MIO0) {
+                length += 3;
+            } else {
+                // Yay0 takes long lengths from the literal stream
+                length = (length == 0) ? literals.u8() + 0x12 : length + 2;
+            }
+            if (!copy_backreference(out, distance, length, block.decompressed_size)) {
+                return false;
+            }
+        }
+    }
+
+    return !control_data.failed() && !links.failed() && !literals.failed();
+}
+
+// Decompress a block into `scratch` in host word order, returning false if the block turned out not to be valid
+bool decompress_block(std::span<const uint8_t> rom_bytes, const CompressedBlock& block, std::vector<uint8_t>& scratch) {
+    scratch.clear();
+    scratch.reserve(nearest_multiple_up<instruction_size>(block.decompressed_size) + scratch_guard_words * instruction_size);
+
+    bool success = (block.format == CompressionFormat::Yaz0) ?
+        decompress_yaz0(rom_bytes, block, scratch) :
+        decompress_yay0_mio0(rom_bytes, block, scratch);
+    if (!success || scratch.size() != block.decompressed_size) {
+        return false;
+    }
+
+    // Pad to a whole word and add the guard words
+    scratch.resize(nearest_multiple_up<instruction_size>(scratch.size()), 0);
+    size_t data_size = scratch.size();
+    scratch.resize(data_size + scratch_guard_words * instruction_size);
+
+    // The decompressed data is big-endian, so swap it to host order like `read_rom` does
+    for (size_t i = 0; i < data_size; i += instruction_size) {
+        uint32_t be_word = (uint32_t{scratch[i]} << 24) | (uint32_t{scratch[i + 1]} << 16) | (uint32_t{scratch[i + 2]} << 8) | scratch[i + 3];
+        *reinterpret_cast<uint32_t*>(scratch.data() + i) = be_word;
+    }
+    for (size_t i = data_size; i < scratch.size(); i += instruction_size) {
+        *reinterpret_cast<uint32_t*>(scratch.data() + i) = scratch_guard_word;
+    }
+
+    return true;
+}
+
+// Decompress each of the given blocks on worker threads and find the code regions inside them
+std::vector<CompressedCodeRegion> scan_compressed_blocks(std::span<const uint8_t> rom_bytes, const std::vector<CompressedBlock>& blocks) {
+    size_t thread_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, std::max<size_t>(blocks.size(), 1));
+    std::vector<std::vector<CompressedCodeRegion>> thread_results(thread_count);
+    std::atomic<size_t> next_block = 0;
+
+    auto worker = [&](size_t thread_index) {
+        // Each worker reuses one scratch buffer for all of the blocks it decompresses
+        std::vector<uint8_t> scratch{};
+        while (true) {
+            size_t block_index = next_block.fetch_add(1, std::memory_order_relaxed);
+            if (block_index >= blocks.size()) {
+                break;
+            }
+
+            const CompressedBlock& block = blocks[block_index];
+            if (!decompress_block(rom_bytes, block, scratch)) {
+                continue;
+            }
+
+            // Leave the guard words out of the span being searched
+            std::span<const uint8_t> decompressed{scratch.data(), scratch.size() - scratch_guard_words * instruction_size};
+            for (const RomRegion& region : find_code_regions(decompressed, 0)) {
+                thread_results[thread_index].push_back(CompressedCodeRegion{
+                    .container = block,
+                    .region = region,
+                });
+            }
+        }
+
+        merge_thread_scan_stats();
+    };
+
+    std::vector<std::thread> threads{};
+    threads.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(worker, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<CompressedCodeRegion> ret{};
+    for (const auto& results : thread_results) {
+        ret.insert(ret.end(), results.begin(), results.end());
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const CompressedCodeRegion& a, const CompressedCodeRegion& b) {
+        if (a.container.rom_offset != b.container.rom_offset) {
+            return a.container.rom_offset < b.container.rom_offset;
+        }
+        return a.region.rom_start < b.region.rom_start;
+    });
+
+    return ret;
+}
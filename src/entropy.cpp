@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "findcode.h"
+
+// Blocks with more entropy than this (in bits per byte) are considered compressed or otherwise not code
+// MIPS code is typically between 5.5 and 6.5 bits per byte.
+constexpr float max_code_entropy = 7.5f;
+
+// Blocks where more than 1 in this many words has a primary opcode that never appears in N64 code aren't code
+// Uniformly random words hit one of these opcodes about 1 in 4 times.
+constexpr size_t max_invalid_opcode_ratio = 8;
+
+// Bitmask of primary opcodes (the top 6 bits of an instruction) that `is_valid` always rejects:
+// cop3, the reserved 0x1C-0x1F range, and the ll/sc and coprocessor 2/3 loads and stores.
+constexpr uint64_t invalid_primary_opcodes =
+    (1ULL << 0x13) |
+    (1ULL << 0x1C) | (1ULL << 0x1D) | (1ULL << 0x1E) | (1ULL << 0x1F) |
+    (1ULL << 0x30) | (1ULL << 0x32) | (1ULL << 0x33) | (1ULL << 0x34) | (1ULL << 0x36) |
+    (1ULL << 0x38) | (1ULL << 0x3A) | (1ULL << 0x3B) | (1ULL << 0x3C) | (1ULL << 0x3E);
+
+// Table of n * log2(n) for every possible byte count in a block, so entropy doesn't need a log per histogram bucket
+const std::array<float, entropy_block_size + 1>& count_log_table() {
+    static const std::array<float, entropy_block_size + 1> table = [] {
+        std::array<float, entropy_block_size + 1> ret{};
+        for (size_t n = 1; n <= entropy_block_size; n++) {
+            ret[n] = static_cast<float>(static_cast<double>(n) * std::log2(static_cast<double>(n)));
+        }
+        return ret;
+    }();
+    return table;
+}
+
+// Calculate the shannon entropy of a block of bytes in bits per byte
+float block_entropy(std::span<const uint8_t> block) {
+    // Use four interleaved histograms so consecutive identical bytes don't serialize on the same counter
+    std::array<std::array<uint16_t, 256>, 4> histograms{};
+    size_t i = 0;
+
+    for (; i + 4 <= block.size(); i += 4) {
+        histograms[0][block[i + 0]]++;
+        histograms[1][block[i + 1]]++;
+        histograms[2][block[i + 2]]++;
+        histograms[3][block[i + 3]]++;
+    }
+    for (; i < block.size(); i++) {
+        histograms[0][block[i]]++;
+    }
+
+    const auto& log_table = count_log_table();
+    float sum = 0.0f;
+    for (size_t value = 0; value < 256; value++) {
+        size_t count = histograms[0][value] + histograms[1][value] + histograms[2][value] + histograms[3][value];
+        sum += log_table[count];
+    }
+
+    // H = log2(N) - sum(c * log2(c)) / N
+    float total = static_cast<float>(block.size());
+    return std::log2(total) - sum / total;
+}
+
+// Count the words in a block whose primary opcode never appears in N64 code
+size_t count_invalid_opcodes(std::span<const uint8_t> block) {
+    size_t count = 0;
+
+    // Branchless so the compiler can vectorize it with variable shifts
+    for (size_t offset = 0; offset + instruction_size <= block.size(); offset += instruction_size) {
+        uint32_t opcode = read32(block, offset) >> 26;
+        count += (invalid_primary_opcodes >> opcode) & 1;
+    }
+
+    return count;
+}
+
+// Determine which `entropy_block_size` blocks of the rom could plausibly contain code
+std::vector<uint8_t> find_plausible_code_blocks(std::span<const uint8_t> rom_bytes) {
+    size_t block_count = nearest_multiple_up<entropy_block_size>(rom_bytes.size()) / entropy_block_size;
+    std::vector<uint8_t> ret(block_count, 1);
+
+    for (size_t block_index = 0; block_index < block_count; block_index++) {
+        size_t block_start = block_index * entropy_block_size;
+        std::span<const uint8_t> block = rom_bytes.subspan(block_start, std::min(entropy_block_size, rom_bytes.size() - block_start));
+
+        size_t word_count = block.size() / instruction_size;
+        if (word_count == 0) {
+            continue;
+        }
+
+        // The opcode check is cheaper, so run it first
+        if (count_invalid_opcodes(block) * max_invalid_opcode_ratio > word_count) {
+            ret[block_index] = 0;
+        } else if (block_entropy(block) > max_code_entropy) {
+            ret[block_index] = 0;
+        }
+    }
+
+    return ret;
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <vector>
 #include <span>
@@ -7,19 +9,65 @@
 
 #include "findcode.h"
 
-constexpr uint32_t jr_ra = 0x03E00008;
-
-// Search a span for any instances of the instruction `jr $ra`
-std::vector<size_t> find_return_locations(std::span<const uint8_t> rom_bytes) {
+// Search a span for any instances of the instruction `jr $ra`, starting at `code_start`
+// If `compressed_blocks` is provided, also record the headers of any compressed blocks that are seen
+std::vector<size_t> find_return_locations(std::span<const uint8_t> rom_bytes, size_t code_start, std::vector<CompressedBlock>* compressed_blocks,
+    const RomWordIndex& word_index)
+{
+    PhaseTimer timer{ScanPhase::find_return_locations};
     std::vector<size_t> ret{};
+    size_t decoded_count = 0;
     ret.reserve(1024);
 
-    for (size_t rom_addr = 0x1000; rom_addr < rom_bytes.size(); rom_addr += instruction_size) {
+    std::vector<uint8_t> plausible_blocks{};
+    if (entropy_filter) {
+        plausible_blocks = find_plausible_code_blocks(rom_bytes);
+    }
+
+    auto fill = find_next_fill(word_index, code_start);
+    for (size_t rom_addr = code_start; rom_addr < rom_bytes.size(); rom_addr += instruction_size) {
+        // Skip blocks that don't look like code. The previous block also has to fail the check, since a function
+        // that ends near the start of a block is mostly in the previous one.
+        if (entropy_filter && rom_addr % entropy_block_size == 0) {
+            size_t block_index = rom_addr / entropy_block_size;
+            bool prev_plausible = block_index > 0 && plausible_blocks[block_index - 1];
+            if (!plausible_blocks[block_index] && !prev_plausible) {
+                size_t block_end = std::min(rom_addr + entropy_block_size, rom_bytes.size());
+                // Compressed data is the most likely reason for the block to be skipped, so still look for headers in it
+                if (compressed_blocks != nullptr) {
+                    for (size_t header_addr = rom_addr; header_addr < block_end; header_addr += instruction_size) {
+                        check_compression_header(rom_bytes, header_addr, *compressed_blocks);
+                    }
+                }
+                rom_addr = block_end - instruction_size;
+                continue;
+            }
+        }
+
+        // Jump over fill, which can't contain a `jr $ra` or a compression header. Stop at the next entropy block so
+        // that block still gets checked.
+        while (fill != word_index.fills.end() && fill->rom_end <= rom_addr) {
+            ++fill;
+        }
+        if (fill != word_index.fills.end() && rom_addr >= fill->rom_start) {
+            size_t fill_end = fill->rom_end;
+            if (entropy_filter) {
+                fill_end = std::min(fill_end, (rom_addr / entropy_block_size + 1) * entropy_block_size);
+            }
+            rom_addr = fill_end - instruction_size;
+            continue;
+        }
+
         uint32_t rom_word = *reinterpret_cast<const uint32_t*>(rom_bytes.data() + rom_addr);
 
+        if (compressed_blocks != nullptr) {
+            check_compression_header(rom_bytes, rom_addr, *compressed_blocks);
+        }
+
         if (rom_word == jr_ra) {
             // Found a jr $ra, make sure the delay slot is also a valid instruction and if so mark this as a code region
             uint32_t next_word = *reinterpret_cast<const uint32_t*>(rom_bytes.data() + rom_addr + instruction_size);
+            decoded_count++;
 
             // This may be microcode, so check instruction validity for both CPU and RSP
             rabbitizer::InstructionCpu next_instr_cpu{next_word, 0};
@@ -30,6 +78,7 @@ std::vector<size_t> find_return_locations(std::span<const uint8_t> rom_bytes) {
         }
     }
 
+    timer.add_work(rom_bytes.size() - code_start, decoded_count);
     return ret;
 }
 
@@ -50,9 +99,10 @@ bool is_unused_n64_instruction(InstrId id) {
 // Check if a given instruction is valid via several metrics
 bool is_valid(const rabbitizer::InstructionCpu& instr) {
     InstrId id = instr.getUniqueId();
+    count_validity_check(false);
     // Check for instructions with invalid bits or invalid opcodes
-    if (!instr.isValid() || id == InstrId::cpu_INVALID) {
-        return false;
+    if (rule_enabled(RejectRule::invalid_opcode) && (!instr.isValid() || id == InstrId::cpu_INVALID)) {
+        return reject_word(RejectRule::invalid_opcode);
     }
 
     bool instr_is_store = instr.doesStore();
@@ -60,8 +110,9 @@ bool is_valid(const rabbitizer::InstructionCpu& instr) {
     bool instr_is_fpr_load = instr.doesLoad() && instr.isFloat();
 
     // Check for loads or stores with an offset from $zero
-    if ((instr_is_store || instr_is_gpr_load || instr_is_fpr_load) && instr.GetO32_rs() == RegisterId::GPR_O32_zero) {
-        return false;
+    if (rule_enabled(RejectRule::zero_base) && (instr_is_store || instr_is_gpr_load || instr_is_fpr_load) &&
+        instr.GetO32_rs() == RegisterId::GPR_O32_zero) {
+        return reject_word(RejectRule::zero_base);
     }
 
     // This check is disabled as some compilers can generate load to $zero for a volatile dereference
@@ -71,59 +122,78 @@ bool is_valid(const rabbitizer::InstructionCpu& instr) {
     // }
 
     // Check for arithmetic that outputs to $zero
-    if (has_zero_output(instr) && !instr_is_gpr_load) {
-        return false;
+    if (rule_enabled(RejectRule::zero_output) && has_zero_output(instr) && !instr_is_gpr_load) {
+        return reject_word(RejectRule::zero_output);
     }
 
     // Check for mtc0 or mfc0 with invalid registers
-    if ((id == InstrId::cpu_mtc0 || id == InstrId::cpu_mfc0) && invalid_cop0_register((int)instr.GetO32_rd())) {
-        return false;
+    if (rule_enabled(RejectRule::cop0_register) && (id == InstrId::cpu_mtc0 || id == InstrId::cpu_mfc0) &&
+        invalid_cop0_register((int)instr.GetO32_rd())) {
+        return reject_word(RejectRule::cop0_register);
     }
 
     // Check for instructions that wouldn't be in an N64 game, despite being valid
-    if (is_unused_n64_instruction(id)) {
-        return false;
+    if (rule_enabled(RejectRule::unused_n64_instruction) && is_unused_n64_instruction(id)) {
+        return reject_word(RejectRule::unused_n64_instruction);
     }
 
     // Check for cache instructions with invalid parameters
-    if (id == InstrId::cpu_cache) {
+    if (rule_enabled(RejectRule::cache_params) && id == InstrId::cpu_cache) {
         uint32_t cache_param = instr.Get_op();
         uint32_t cache_op = cache_param >> 2;
         uint32_t cache_type = cache_param & 0x3;
 
         // Only cache operations 0-6 and cache types 0-1 are valid
         if (cache_op > 6 || cache_type > 1) {
-            return false;
+            return reject_word(RejectRule::cache_params);
         }
     }
 
     // Check for cop2 instructions, which are invalid for the N64's CPU
-    if (id == InstrId::cpu_lwc2 || id == InstrId::cpu_ldc2 || id == InstrId::cpu_swc2 || id == InstrId::cpu_sdc2) {
-        return false;
+    if (rule_enabled(RejectRule::cop2_load_store) &&
+        (id == InstrId::cpu_lwc2 || id == InstrId::cpu_ldc2 || id == InstrId::cpu_swc2 || id == InstrId::cpu_sdc2)) {
+        return reject_word(RejectRule::cop2_load_store);
     }
 
     // Check for trap instructions
-    if (instr.isTrap()) {
-        return false;
+    if (rule_enabled(RejectRule::trap) && instr.isTrap()) {
+        return reject_word(RejectRule::trap);
     }
 
     // Check for ctc0 and cfc0, which aren't valid on the N64
-    if (id == InstrId::cpu_ctc0 || id == InstrId::cpu_cfc0) {
-        return false;
+    if (rule_enabled(RejectRule::ctc0_cfc0) && (id == InstrId::cpu_ctc0 || id == InstrId::cpu_cfc0)) {
+        return reject_word(RejectRule::ctc0_cfc0);
     }
 
     // Check for instructions that don't exist on the N64's CPU
-    if (id == InstrId::cpu_pref) {
-        return false;
+    if (rule_enabled(RejectRule::pref) && id == InstrId::cpu_pref) {
+        return reject_word(RejectRule::pref);
     }
 
     return true;
 }
 
-// Searches backwards from the given rom address until it hits an invalid instruction
-size_t find_code_start(std::span<const uint8_t> rom_bytes, size_t rom_addr) {
-    while (rom_addr > 0x1000) {
+// Searches backwards from the given rom address until it hits an invalid instruction or `code_start`
+size_t find_code_start(std::span<const uint8_t> rom_bytes, size_t rom_addr, size_t code_start, const RomWordIndex& word_index) {
+    // Number of fills that start before `rom_addr`, so the one before the walk is at this minus one
+    size_t fills_before = static_cast<size_t>(find_next_fill(word_index, rom_addr) - word_index.fills.begin());
+    if (fills_before < word_index.fills.size() && word_index.fills[fills_before].rom_start < rom_addr) {
+        fills_before++;
+    }
+
+    while (rom_addr > code_start) {
         size_t cur_rom_addr = rom_addr - instruction_size;
+
+        // Jump over fill that's valid code, since every word of it would pass
+        if (fills_before > 0 && cur_rom_addr < word_index.fills[fills_before - 1].rom_end) {
+            const FillRange& fill = word_index.fills[fills_before - 1];
+            fills_before--;
+            if (fill.cpu_valid) {
+                rom_addr = std::max(fill.rom_start, code_start);
+                continue;
+            }
+        }
+
         rabbitizer::InstructionCpu cur_instr{read32(rom_bytes, cur_rom_addr), 0};
 
         if (!is_valid(cur_instr)) {
@@ -137,8 +207,20 @@ size_t find_code_start(std::span<const uint8_t> rom_bytes, size_t rom_addr) {
 }
 
 // Searches forwards from the given rom address until it hits an invalid instruction
-size_t find_code_end(std::span<const uint8_t> rom_bytes, size_t rom_addr) {
+size_t find_code_end(std::span<const uint8_t> rom_bytes, size_t rom_addr, const RomWordIndex& word_index) {
+    auto fill = find_next_fill(word_index, rom_addr);
     while (rom_addr > 0) {
+        // Jump over fill that's valid code, since every word of it would pass
+        if (fill != word_index.fills.end() && rom_addr >= fill->rom_start) {
+            bool cpu_valid = fill->cpu_valid;
+            size_t fill_end = fill->rom_end;
+            ++fill;
+            if (cpu_valid) {
+                rom_addr = fill_end;
+                continue;
+            }
+        }
+
         rabbitizer::InstructionCpu cur_instr{read32(rom_bytes, rom_addr), 0};
 
         if (!is_valid(cur_instr)) {
@@ -152,121 +234,254 @@ size_t find_code_end(std::span<const uint8_t> rom_bytes, size_t rom_addr) {
 }
 
 // Check if a given instruction word is an unconditional non-linking branch (i.e. `b`, `j`, or `jr`)
+// This matches the instruction ids rabbitizer would give (`b` is `beq $zero, $zero`), but doesn't need to decode the word
 bool is_unconditional_branch(uint32_t instruction_word) {
-    rabbitizer::InstructionCpu instr{instruction_word, 0};
-    InstrId id = instr.getUniqueId();
+    uint32_t opcode = instruction_word >> 26;
+    bool is_j = opcode == 0x02;
+    bool is_jr = opcode == 0x00 && (instruction_word & 0x3F) == 0x08;
+    bool is_b = (instruction_word >> 16) == 0x1000;
 
-    return id == InstrId::cpu_b || id == InstrId::cpu_j || id == InstrId::cpu_jr;
+    return is_j || is_jr || is_b;
 }
 
-// Trims zeroes from the start of a code region and "loose" instructions from the end
-void trim_region(RomRegion& codeseg, std::span<const uint8_t> rom_bytes) {
-    size_t start = codeseg.rom_start;
-    size_t end = codeseg.rom_end;
-    size_t invalid_start_count = count_invalid_start_instructions(codeseg, rom_bytes);
+// Add the run of identical words [start_word, end_word) to the index if it's long enough to matter
+void add_identical_run(RomWordIndex& index, size_t start_word, size_t end_word, uint32_t word) {
+    if (end_word - start_word < min_indexed_run_length) {
+        return;
+    }
 
-    start += invalid_start_count * instruction_size;
-    
-    // Remove leading nops
-    while (read32(rom_bytes, start) == 0 && end > start) {
-        start += instruction_size;
+    rabbitizer::InstructionCpu cpu_instr{word, 0};
+    rabbitizer::InstructionRsp rsp_instr{word, 0};
+    index.identical_runs.push_back(WordRun{
+        .start_word = static_cast<uint32_t>(start_word),
+        .length = static_cast<uint32_t>(end_word - start_word),
+        .word = word,
+        .cpu_load_store = cpu_instr.doesLoad() || cpu_instr.doesStore(),
+        .rsp_load_store = rsp_instr.doesLoad() || rsp_instr.doesStore(),
+    });
+}
+
+// Build the branch and nonzero word bitmaps, the identical word run index and the fill ranges for a rom
+RomWordIndex build_rom_word_index(std::span<const uint8_t> rom_bytes) {
+    PhaseTimer timer{ScanPhase::word_index};
+    size_t word_count = rom_bytes.size() / instruction_size;
+    RomWordIndex ret{
+        .branch_bits = std::vector<uint64_t>((word_count + 63) / 64),
+        .nonzero_bits = std::vector<uint64_t>((word_count + 63) / 64),
+        .identical_runs = {},
+        .fills = {},
+    };
+
+    size_t run_start = 0;
+    uint32_t run_word = 0;
+    for (size_t word = 0; word < word_count; word++) {
+        uint32_t instruction_word = read32(rom_bytes, word * instruction_size);
+        uint64_t bit = uint64_t{1} << (word % 64);
+        if (is_unconditional_branch(instruction_word)) {
+            ret.branch_bits[word / 64] |= bit;
+        }
+        if (instruction_word != 0) {
+            ret.nonzero_bits[word / 64] |= bit;
+        }
+        // End the current run when the word changes
+        if (instruction_word != run_word || word == 0) {
+            if (word != 0) {
+                add_identical_run(ret, run_start, word, run_word);
+            }
+            run_start = word;
+            run_word = instruction_word;
+        }
+    }
+    if (word_count != 0) {
+        add_identical_run(ret, run_start, word_count, run_word);
+    }
+
+    // Long runs of 0x00 or 0xFF words are padding
+    for (const WordRun& run : ret.identical_runs) {
+        if ((run.word == 0x00000000 || run.word == 0xFFFFFFFF) && run.length * instruction_size >= min_fill_size) {
+            ret.fills.push_back(FillRange{
+                .rom_start = run.start_word * instruction_size,
+                .rom_end = (run.start_word + run.length) * instruction_size,
+                .cpu_valid = is_valid(rabbitizer::InstructionCpu{run.word, 0}),
+                .rsp_valid = is_valid_rsp(rabbitizer::InstructionRsp{run.word, 0}),
+            });
+        }
+    }
+
+    timer.add_work(rom_bytes.size(), 0);
+    return ret;
+}
+
+// Find the first fill that ends after the given rom address
+std::vector<FillRange>::const_iterator find_next_fill(const RomWordIndex& word_index, size_t rom_addr) {
+    return std::partition_point(word_index.fills.begin(), word_index.fills.end(), [rom_addr](const FillRange& fill) {
+        return fill.rom_end <= rom_addr;
+    });
+}
+
+// Find the first set bit in [first, last) of a bitmap, or `last` if there isn't one
+size_t find_next_set_bit(const std::vector<uint64_t>& bits, size_t first, size_t last) {
+    size_t word = first / 64;
+    // Mask off the bits before `first` in its chunk
+    uint64_t chunk = bits[word] & (~uint64_t{0} << (first % 64));
+    while (true) {
+        if (chunk != 0) {
+            size_t found = word * 64 + static_cast<size_t>(std::countr_zero(chunk));
+            return std::min(found, last);
+        }
+        word++;
+        if (word * 64 >= last) {
+            return last;
+        }
+        chunk = bits[word];
     }
+}
+
+// Find the last set bit in [first, last) of a bitmap, or `last` if there isn't one
+size_t find_prev_set_bit(const std::vector<uint64_t>& bits, size_t first, size_t last) {
+    if (first >= last) {
+        return last;
+    }
+    size_t word = (last - 1) / 64;
+    // Mask off the bits after `last - 1` in its chunk
+    uint64_t chunk = bits[word] & (~uint64_t{0} >> (63 - (last - 1) % 64));
+    while (true) {
+        if (chunk != 0) {
+            size_t found = word * 64 + 63 - static_cast<size_t>(std::countl_zero(chunk));
+            return found >= first ? found : last;
+        }
+        if (word * 64 <= first) {
+            return last;
+        }
+        word--;
+        chunk = bits[word];
+    }
+}
+
+// Trims invalid start instructions and zeroes from the start of a code region, returning the new start
+size_t trim_region_start(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index) {
+    size_t start = rom_start + count_invalid_start_instructions(RomRegion{rom_start, rom_end}, rom_bytes) * instruction_size;
     
+    // Remove leading nops by skipping to the first nonzero word
+    if (rom_end > start) {
+        size_t first_nonzero = find_next_set_bit(word_index.nonzero_bits, start / instruction_size, rom_end / instruction_size);
+        start = first_nonzero * instruction_size;
+    }
+
+    return start;
+}
+
+// Trims "loose" instructions from the end of a code region, returning the new end
+size_t trim_region_end(size_t rom_start, size_t rom_end, const RomWordIndex& word_index) {
     // Any instruction that isn't eventually followed by an unconditional non-linking branch (b, j, jr) would run into
-    // invalid code, so scan backwards until we see an unconditional branch and remove anything after it.
-    // Scan two instructions back (8 bytes before the end) instead of one to include the delay slot.
-    while (!is_unconditional_branch(read32(rom_bytes, end - 2 * instruction_size)) && end > start) {
-        end -= instruction_size;
+    // invalid code, so find the last unconditional branch and remove anything after it.
+    // Look for it two instructions back (8 bytes before the end) instead of one to include the delay slot.
+    if (rom_end <= rom_start) {
+        return rom_end;
     }
-    
+
+    // The branch can be as early as the instruction before the start, which leaves only its delay slot
+    size_t first_word = rom_start / instruction_size - (rom_start >= instruction_size ? 1 : 0);
+    size_t last_word = rom_end / instruction_size - 1;
+    size_t branch_word = find_prev_set_bit(word_index.branch_bits, first_word, last_word);
+    return branch_word != last_word ? (branch_word + 2) * instruction_size : rom_start;
+}
+
+// Trims zeroes from the start of a code region and "loose" instructions from the end
+void trim_region(RomRegion& codeseg, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index) {
+    PhaseTimer timer{ScanPhase::trimming};
+    size_t start = trim_region_start(codeseg.rom_start, codeseg.rom_end, rom_bytes, word_index);
+    size_t end = trim_region_end(start, codeseg.rom_end, word_index);
+
+    // The start check decodes at most every instruction it skips plus the first valid one, and the rest is bitmap lookups
+    timer.add_work(codeseg.rom_end - codeseg.rom_start, (start - codeseg.rom_start) / instruction_size + 1);
     codeseg.rom_start = start;
     codeseg.rom_end = end;
 }
 
-// Check if a given rom range is valid CPU instructions
-bool check_range_cpu(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes) {
-    uint32_t prev_word = 0xFFFFFFFF;
-    int identical_count = 0;
-    for (size_t offset = rom_start; offset < rom_end; offset += instruction_size) {
-        uint32_t cur_word = read32(rom_bytes, offset);
-        // Check if the previous instruction is identical to this one
-        if (cur_word == prev_word) {
-            // If it is, increase the consecutive identical instruction count
-            identical_count++;
-        } else {
-            // Otherwise, reset the count and update the previous instruction for tracking
-            prev_word = cur_word;
-            identical_count = 0;
+// Find the first rom address in a range where a range check would see too many identical loads or stores in a row,
+// or `rom_end` if there isn't one
+size_t find_identical_load_store(size_t rom_start, size_t rom_end, const RomWordIndex& word_index, bool rsp) {
+    size_t first_word = rom_start / instruction_size;
+    size_t end_word = rom_end / instruction_size;
+    const std::vector<WordRun>& runs = word_index.identical_runs;
+
+    // Runs don't overlap, so the first run that ends after the start of the range is the first one that can be in it
+    auto it = std::partition_point(runs.begin(), runs.end(), [first_word](const WordRun& run) {
+        return run.start_word + run.length <= first_word;
+    });
+
+    for (; it != runs.end() && it->start_word < end_word; ++it) {
+        if (!(rsp ? it->rsp_load_store : it->cpu_load_store)) {
+            continue;
         }
-        rabbitizer::InstructionCpu instr{cur_word, 0};
-        // If there are 3 identical loads or stores in a row, it's not likely to be real code
-        // Use 3 as the count because 2 could be plausible if it's a duplicated instruction by the compiler.
-        // Only check for loads and stores because arithmetic could be duplicated to avoid more expensive operations,
-        // e.g. x + x + x instead of 3 * x. 
-        if (identical_count >= 3 && (instr.doesLoad() || instr.doesStore())) {
-            return false;
+        // Only the part of the run inside of the range counts. The checks start out treating the word before the range
+        // as 0xFFFFFFFF, so a run of that word at the start of the range counts one more than it has.
+        size_t clipped_start = std::max<size_t>(it->start_word, first_word);
+        size_t extra = (clipped_start == first_word && it->word == 0xFFFFFFFF) ? 1 : 0;
+        // The check fails on the fourth identical word
+        size_t reject_word_index = clipped_start + 3 - extra;
+        if (reject_word_index < it->start_word + it->length && reject_word_index < end_word) {
+            return reject_word_index * instruction_size;
         }
+    }
+
+    return rom_end;
+}
+
+// Check if a given rom range is valid CPU instructions
+bool check_range_cpu(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes, const RomWordIndex& word_index) {
+    // If there are 3 identical loads or stores in a row, it's not likely to be real code
+    // Use 3 as the count because 2 could be plausible if it's a duplicated instruction by the compiler.
+    // Only check for loads and stores because arithmetic could be duplicated to avoid more expensive operations,
+    // e.g. x + x + x instead of 3 * x. 
+    // Look the first one up in the run index, then only words before it need to be checked for validity.
+    size_t check_end = rom_end;
+    if (rule_enabled(RejectRule::identical_load_store)) {
+        check_end = find_identical_load_store(rom_start, rom_end, word_index, false);
+    }
+    for (size_t offset = rom_start; offset < check_end; offset += instruction_size) {
+        rabbitizer::InstructionCpu instr{read32(rom_bytes, offset), 0};
         if (!is_valid(instr)) {
             return false;
         }
     }
+    if (check_end != rom_end) {
+        return reject_word(RejectRule::identical_load_store);
+    }
     return true;
 }
 
-// Find all the regions of code in the given rom
-std::vector<RomRegion> find_code_regions(std::span<const uint8_t> rom_bytes) {
+// Find all the regions of code in the given rom, starting the search at `code_start`
+std::vector<RomRegion> find_code_regions(std::span<const uint8_t> rom_bytes, size_t code_start, std::vector<CompressedBlock>* compressed_blocks) {
     std::vector<RomRegion> ret{};
     
-    std::vector<size_t> return_addrs = find_return_locations(rom_bytes);
-
-    auto it = return_addrs.begin();
-    while (it != return_addrs.end()) {
-        size_t region_start = find_code_start(rom_bytes, *it);
-        size_t region_end = find_code_end(rom_bytes, *it);
-        ret.emplace_back(region_start, region_end);
-        
-        while (it != return_addrs.end() && *it < ret.back().rom_end) {
-            it++;
-        }
-        
-        trim_region(ret.back(), rom_bytes);
-        
-        // If the current region is close enough to the previous region, check if there's valid RSP microcode between the two
-        if (ret.size() > 1 && ret.back().rom_start - ret[ret.size() - 2].rom_end < microcode_check_threshold) {
-            // Check if there's a range of valid CPU instructions between these two regions
-            bool valid_range = check_range_cpu(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes);
-            // If there isn't check for RSP instructions
-            if (!valid_range) {
-                valid_range = check_range_rsp(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes);
-                // If RSP instructions were found, mark the first region as having RSP instructions
-                if (valid_range) {
-                    ret[ret.size() - 2].has_rsp = true;
-                }
-            }
-            if (valid_range) {
-                // If there is, merge the two regions
-                size_t new_end = ret.back().rom_end;
-                ret.pop_back();
-                ret.back().rom_end = new_end;
-            }
-        }
+    RomWordIndex word_index = build_rom_word_index(rom_bytes);
+    std::vector<size_t> return_addrs = find_return_locations(rom_bytes, code_start, compressed_blocks, word_index);
 
-        // If the region has microcode, search forward until valid RSP instructions end
-        if (ret.back().has_rsp) {
-            // Keep advancing the region's end until either the stop point is reached or something
-            // that isn't a valid RSP instruction is seen
-            while (ret.back().rom_end < rom_bytes.size() && is_valid_rsp({read32(rom_bytes, ret.back().rom_end), 0})) {
-                ret.back().rom_end += instruction_size;
-            }
+    // Grow a candidate region from each seed, then sort, trim and merge them into the final regions
+    std::vector<RegionCandidate> candidates = grow_region_candidates(rom_bytes, return_addrs, code_start, word_index);
+    sort_region_candidates(candidates);
+    trim_region_candidates(rom_bytes, candidates, word_index);
+    ret = merge_region_candidates(rom_bytes, candidates, word_index);
 
-            // Trim the region again to get rid of any junk that may have been found after its end
-            trim_region(ret.back(), rom_bytes);
+    PhaseTimer analysis_timer{ScanPhase::analysis};
 
-            // Skip any return addresses that are now part of the region
-            while (it != return_addrs.end() && *it < ret.back().rom_end) {
-                it++;
-            }
-        }
+    // Find jump tables, which also links regions that were split apart within a function
+    link_jump_tables(ret, code_start, rom_bytes, [rom_bytes, &word_index](size_t start, size_t end) {
+        return check_range_cpu(start, end, rom_bytes, word_index);
+    });
+
+    // Score each region on how much its register usage looks like real code
+    for (RomRegion& region : ret) {
+        region.confidence = region_confidence(analyze_region_dataflow(region, rom_bytes));
+    }
+
+    // Infer where each region is loaded in memory
+    for (RomRegion& region : ret) {
+        region.references = collect_region_references(region, rom_bytes);
+        infer_region_vram(region, region.references);
+        analysis_timer.add_work(region.rom_end - region.rom_start, 0);
     }
 
     return ret;
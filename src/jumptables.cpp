@@ -0,0 +1,379 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+#include "findcode.h"
+
+// How many instructions before a `jr` to search for the rest of the jump table idiom
+constexpr size_t jump_table_idiom_window = 12;
+// How many instructions before the idiom's `lui` to search for the bounds check that guards it
+constexpr size_t jump_table_bounds_window = 8;
+// Maximum rom distance between a `jr` and the jump table it reads from
+constexpr size_t jump_table_max_distance = 0x100000;
+// Maximum rom distance between a `jr` and the cases it jumps to, since they're in the same function
+constexpr size_t jump_table_max_case_distance = 0x10000;
+// Jump tables with fewer entries than this are too likely to be coincidental
+constexpr size_t jump_table_min_entries = 2;
+// Jump tables claiming more entries than this are assumed to be false positives
+constexpr size_t jump_table_max_entries = 0x400;
+
+// A `jr` whose target is loaded from a table, before the table has been located in the rom
+struct JumpTableIdiom {
+    size_t jr_rom;
+    uint32_t table_vram;
+    // Number of entries from the bounds check before the jump, or 0 if there wasn't one
+    size_t entry_count;
+};
+
+// Find the bounds check guarding a jump table, searching back from the `jr` to a little before the idiom's `lui`:
+//   sltiu $cond, $index, count
+//   beqz  $cond, default
+// Returns the number of entries it allows, or 0 if there isn't one
+size_t find_jump_table_bounds(const RomRegion& region, size_t jr_rom, size_t lui_rom, std::span<const uint8_t> rom_bytes) {
+    size_t search_start = std::max(region.rom_start, lui_rom - std::min(lui_rom, jump_table_bounds_window * instruction_size));
+
+    for (size_t rom_addr = jr_rom; rom_addr > search_start; ) {
+        rom_addr -= instruction_size;
+        uint32_t word = read32(rom_bytes, rom_addr);
+        if (instr_opcode(word) != opcode_sltiu) {
+            continue;
+        }
+        // Only count it if the branch right after it skips the jump when the index is out of range
+        uint32_t branch = read32(rom_bytes, rom_addr + instruction_size);
+        if (instr_opcode(branch) == opcode_beq && instr_rs(branch) == instr_rt(word) && instr_rt(branch) == 0) {
+            return word & 0xFFFF;
+        }
+    }
+
+    return 0;
+}
+
+// Try to match the jump table idiom ending in the `jr` at `jr_rom`:
+//   sltiu $cond, $index, count       (optional, found by `find_jump_table_bounds`)
+//   beqz  $cond, default
+//   lui   $base, %hi(table)
+//   addiu $base, $base, %lo(table)   (optional)
+//   sll   $index, $index, 2          (optional, anything can compute the index)
+//   addu  $addr, $base, $index       (optional)
+//   lw    $target, %lo(table)($addr)
+//   jr    $target
+// Both inputs of the addu are followed back since either could be the base. Whichever one is written by something
+// other than the idiom's instructions is the index, so it stops being followed.
+std::optional<JumpTableIdiom> match_jump_table_idiom(const RomRegion& region, size_t jr_rom, std::span<const uint8_t> rom_bytes) {
+    uint32_t jr_word = read32(rom_bytes, jr_rom);
+    uint32_t target_reg = instr_rs(jr_word);
+    size_t search_start = std::max(region.rom_start, jr_rom - std::min(jr_rom, jump_table_idiom_window * instruction_size));
+
+    // Registers that could hold part of the table address, and the offset accumulated into each one so far
+    uint32_t base_regs = 0;
+    std::array<int64_t, 32> offsets{};
+    bool found_load = false;
+
+    for (size_t rom_addr = jr_rom; rom_addr > search_start; ) {
+        rom_addr -= instruction_size;
+        uint32_t word = read32(rom_bytes, rom_addr);
+        uint32_t opcode = instr_opcode(word);
+
+        if (!found_load) {
+            // The first write to the jump target register has to be the load from the table
+            if (raw_output_gpr(word) != target_reg) {
+                continue;
+            }
+            if (opcode != opcode_lw) {
+                return std::nullopt;
+            }
+            found_load = true;
+            offsets[instr_rs(word)] = instr_simm(word);
+            base_regs = 1U << instr_rs(word);
+            continue;
+        }
+
+        uint32_t output = raw_output_gpr(word);
+        if (output == 0 || !((base_regs >> output) & 1)) {
+            continue;
+        }
+
+        if (opcode == opcode_special && instr_funct(word) == funct_addu) {
+            // The table address is one of the addu's inputs
+            int64_t offset = offsets[output];
+            base_regs &= ~(1U << output);
+            base_regs |= (1U << instr_rs(word)) | (1U << instr_rt(word));
+            offsets[instr_rs(word)] = offset;
+            offsets[instr_rt(word)] = offset;
+        } else if (opcode == opcode_addiu && instr_rs(word) == output) {
+            offsets[output] += instr_simm(word);
+        } else if (opcode == opcode_lui) {
+            uint32_t table_vram = static_cast<uint32_t>((static_cast<int64_t>(word & 0xFFFF) << 16) + offsets[output]);
+            if (!is_code_pointer(table_vram)) {
+                return std::nullopt;
+            }
+            // Compilers put the bounds check before the lui, so it's searched for separately
+            return JumpTableIdiom{
+                .jr_rom = jr_rom,
+                .table_vram = table_vram,
+                .entry_count = find_jump_table_bounds(region, jr_rom, rom_addr, rom_bytes),
+            };
+        } else {
+            // Something else computed this register, so it's the index rather than the base
+            base_regs &= ~(1U << output);
+            if (base_regs == 0) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+// Find the rom offsets of every word that looks like a code pointer and is next to another one, as these are the only
+// places a jump table can start
+std::vector<size_t> find_pointer_words(std::span<const uint8_t> rom_bytes, size_t code_start) {
+    std::vector<size_t> ret{};
+    bool prev_pointer = false;
+
+    for (size_t rom_addr = code_start; rom_addr + instruction_size <= rom_bytes.size(); rom_addr += instruction_size) {
+        bool cur_pointer = is_code_pointer(read32(rom_bytes, rom_addr));
+        if (cur_pointer && !prev_pointer && rom_addr + 2 * instruction_size <= rom_bytes.size() &&
+            is_code_pointer(read32(rom_bytes, rom_addr + instruction_size)))
+        {
+            ret.push_back(rom_addr);
+        } else if (cur_pointer && prev_pointer) {
+            ret.push_back(rom_addr);
+        }
+        prev_pointer = cur_pointer;
+    }
+
+    return ret;
+}
+
+// Find the index of the region containing the given rom address, if any
+std::optional<size_t> find_region_index(const std::vector<RomRegion>& regions, size_t rom_addr) {
+    auto it = std::upper_bound(regions.begin(), regions.end(), rom_addr,
+        [](size_t addr, const RomRegion& region) { return addr < region.rom_start; });
+    if (it == regions.begin() || rom_addr >= std::prev(it)->rom_end) {
+        return std::nullopt;
+    }
+    return static_cast<size_t>(std::distance(regions.begin(), it) - 1);
+}
+
+// A located jump table and the range of regions its cases land in
+struct ResolvedJumpTable {
+    JumpTable table;
+    size_t first_region;
+    size_t last_region;
+};
+
+// Difference between the vram and rom addresses of a jump table, which is the same for every table in a segment
+int64_t jump_table_vram_delta(const JumpTable& table) {
+    return static_cast<int64_t>(table.vram) - static_cast<int64_t>(table.rom_start);
+}
+
+// Find every run of pointer words that could be the table an idiom reads from, which is any run that maps every entry
+// to code near the `jr` assuming the table and code are linked together. Neighboring tables in the same rodata usually
+// pass too, since shifting every case by the distance between the tables still lands in code.
+std::vector<ResolvedJumpTable> find_jump_table_candidates(const JumpTableIdiom& idiom, const std::vector<RomRegion>& regions,
+    const std::vector<size_t>& pointer_words, std::span<const uint8_t> rom_bytes)
+{
+    std::vector<ResolvedJumpTable> ret{};
+    size_t search_start = idiom.jr_rom - std::min(idiom.jr_rom, jump_table_max_distance);
+    size_t search_end = idiom.jr_rom + jump_table_max_distance;
+    size_t max_entries = (idiom.entry_count != 0) ? std::min(idiom.entry_count, jump_table_max_entries) : jump_table_max_entries;
+
+    for (auto it = std::lower_bound(pointer_words.begin(), pointer_words.end(), search_start);
+        it != pointer_words.end() && *it < search_end; ++it)
+    {
+        size_t table_rom = *it;
+        // The difference between vram and rom addresses if this is the table
+        int64_t vram_delta = static_cast<int64_t>(idiom.table_vram) - static_cast<int64_t>(table_rom);
+
+        size_t entries = 0;
+        size_t first_region = regions.size();
+        size_t last_region = 0;
+        for (; entries < max_entries && table_rom + (entries + 1) * instruction_size <= rom_bytes.size(); entries++) {
+            uint32_t entry = read32(rom_bytes, table_rom + entries * instruction_size);
+            int64_t target_rom = static_cast<int64_t>(entry) - vram_delta;
+            if (!is_code_pointer(entry) || target_rom < 0 ||
+                static_cast<size_t>(std::abs(target_rom - static_cast<int64_t>(idiom.jr_rom))) > jump_table_max_case_distance)
+            {
+                break;
+            }
+            // Every case has to be in a region that was found
+            std::optional<size_t> region_index = find_region_index(regions, static_cast<size_t>(target_rom));
+            if (!region_index.has_value()) {
+                break;
+            }
+            first_region = std::min(first_region, region_index.value());
+            last_region = std::max(last_region, region_index.value());
+        }
+
+        // If the bounds check gave the table size then every entry has to be valid
+        bool valid = (idiom.entry_count != 0) ? (entries == max_entries) : (entries >= jump_table_min_entries);
+        if (valid && entries >= jump_table_min_entries) {
+            ret.push_back(ResolvedJumpTable{
+                .table = JumpTable{
+                    .rom_start = table_rom,
+                    .rom_end = table_rom + entries * instruction_size,
+                    .vram = idiom.table_vram,
+                    .jr_rom = idiom.jr_rom,
+                },
+                .first_region = first_region,
+                .last_region = last_region,
+            });
+        }
+    }
+
+    return ret;
+}
+
+// Infer the vram and rom difference of a region from its calls, if it has enough of them
+std::optional<int64_t> infer_region_vram_delta(const RomRegion& region, std::span<const uint8_t> rom_bytes) {
+    RomRegion inferred{region.rom_start, region.rom_end};
+    infer_region_vram(inferred, collect_region_references(region, rom_bytes));
+    if (inferred.vram == 0) {
+        return std::nullopt;
+    }
+    return static_cast<int64_t>(inferred.vram) - static_cast<int64_t>(region.rom_start);
+}
+
+// Find the one vram and rom difference that every idiom in a region has a candidate table for, if there's exactly one
+std::optional<int64_t> find_shared_vram_delta(const std::vector<std::vector<ResolvedJumpTable>>& region_candidates) {
+    std::optional<int64_t> ret{};
+
+    for (const ResolvedJumpTable& candidate : region_candidates[0]) {
+        int64_t delta = jump_table_vram_delta(candidate.table);
+        bool shared = std::all_of(region_candidates.begin() + 1, region_candidates.end(),
+            [delta](const std::vector<ResolvedJumpTable>& candidates) {
+                return std::any_of(candidates.begin(), candidates.end(),
+                    [delta](const ResolvedJumpTable& other) { return jump_table_vram_delta(other.table) == delta; });
+            });
+        if (!shared || (ret.has_value() && ret.value() == delta)) {
+            continue;
+        }
+        if (ret.has_value()) {
+            return std::nullopt;
+        }
+        ret = delta;
+    }
+
+    return ret;
+}
+
+// Check if the gaps between the regions a jump table spans are valid CPU instructions, the same as when merging regions.
+// The table itself is skipped, since an inline table is usually what split the function apart.
+bool jump_table_gaps_valid(const std::vector<RomRegion>& regions, const ResolvedJumpTable& table, const GapCheck& gap_valid) {
+    for (size_t i = table.first_region; i < table.last_region; i++) {
+        size_t gap_start = regions[i].rom_end;
+        size_t gap_end = regions[i + 1].rom_start;
+        size_t before_table = std::min(gap_end, table.table.rom_start);
+        size_t after_table = std::max(gap_start, table.table.rom_end);
+        if (gap_start < before_table && !gap_valid(gap_start, before_table)) {
+            return false;
+        }
+        if (after_table < gap_end && !gap_valid(after_table, gap_end)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Find the jump tables used by the code in each region, merge regions that a jump table shows are parts of the same
+// function, and attach each table to the region containing the `jr` that uses it
+void link_jump_tables(std::vector<RomRegion>& regions, size_t code_start, std::span<const uint8_t> rom_bytes,
+    const GapCheck& gap_valid)
+{
+    std::vector<ResolvedJumpTable> resolved{};
+    std::vector<size_t> pointer_words{};
+
+    for (size_t region_index = 0; region_index < regions.size(); region_index++) {
+        const RomRegion& region = regions[region_index];
+        // Candidate tables for each idiom in the region
+        std::vector<std::vector<ResolvedJumpTable>> region_candidates{};
+
+        for (size_t rom_addr = region.rom_start; rom_addr < region.rom_end; rom_addr += instruction_size) {
+            uint32_t word = read32(rom_bytes, rom_addr);
+            if (instr_opcode(word) != opcode_special || instr_funct(word) != funct_jr || instr_rs(word) == reg_ra) {
+                continue;
+            }
+
+            std::optional<JumpTableIdiom> idiom = match_jump_table_idiom(region, rom_addr, rom_bytes);
+            if (!idiom.has_value()) {
+                continue;
+            }
+
+            // Only index the rom's pointers once a jump table idiom has actually been seen
+            if (pointer_words.empty()) {
+                pointer_words = find_pointer_words(rom_bytes, code_start);
+            }
+
+            region_candidates.push_back(find_jump_table_candidates(idiom.value(), regions, pointer_words, rom_bytes));
+        }
+
+        if (region_candidates.empty()) {
+            continue;
+        }
+
+        // Every table the region uses is linked at the same offset from its code. Take that offset from the region's
+        // calls if possible, otherwise from the candidates that all of the region's idioms agree on.
+        std::optional<int64_t> vram_delta = infer_region_vram_delta(region, rom_bytes);
+        if (!vram_delta.has_value()) {
+            vram_delta = find_shared_vram_delta(region_candidates);
+        }
+
+        for (std::vector<ResolvedJumpTable>& candidates : region_candidates) {
+            if (vram_delta.has_value()) {
+                std::erase_if(candidates, [&vram_delta](const ResolvedJumpTable& candidate) {
+                    return jump_table_vram_delta(candidate.table) != vram_delta.value();
+                });
+            }
+            // Guessing between tables that fit equally well would merge the wrong regions
+            if (candidates.size() != 1) {
+                continue;
+            }
+            ResolvedJumpTable& table = candidates[0];
+            table.first_region = std::min(table.first_region, region_index);
+            table.last_region = std::max(table.last_region, region_index);
+            resolved.push_back(table);
+        }
+    }
+
+    // Mark how far each region needs to be merged forward
+    std::vector<size_t> merge_until(regions.size());
+    for (size_t i = 0; i < regions.size(); i++) {
+        merge_until[i] = i;
+    }
+    for (const ResolvedJumpTable& table : resolved) {
+        // Only merge across gaps that could be code, since the table could still be a coincidence
+        if (jump_table_gaps_valid(regions, table, gap_valid)) {
+            merge_until[table.first_region] = std::max(merge_until[table.first_region], table.last_region);
+        }
+    }
+
+    // Merge the regions spanned by each jump table's cases
+    std::vector<RomRegion> merged{};
+    merged.reserve(regions.size());
+    for (size_t i = 0; i < regions.size(); ) {
+        size_t last = merge_until[i];
+        for (size_t j = i + 1; j <= last; j++) {
+            last = std::max(last, merge_until[j]);
+        }
+
+        RomRegion& region = merged.emplace_back(std::move(regions[i]));
+        for (size_t j = i + 1; j <= last; j++) {
+            region.rom_end = std::max(region.rom_end, regions[j].rom_end);
+            region.has_rsp |= regions[j].has_rsp;
+        }
+        i = last + 1;
+    }
+    regions = std::move(merged);
+
+    for (const ResolvedJumpTable& table : resolved) {
+        std::optional<size_t> region_index = find_region_index(regions, table.table.jr_rom);
+        if (region_index.has_value()) {
+            regions[region_index.value()].jump_tables.push_back(table.table);
+        }
+    }
+}
@@ -1,62 +1,65 @@
 #include <cstdlib>
-#include <fstream>
 #include <filesystem>
+#include <string_view>
 #include <vector>
 
 #include "fmt/format.h"
 
 #include "findcode.h"
 
-// Read a rom file from the given path and swap it (if necessary) to little-endian
-std::vector<uint8_t> read_rom(const char* path) {
-    size_t rom_size;
-    std::vector<uint8_t> ret;
-    std::ifstream rom_file{path, std::ios::binary};
+// Command line options
+struct Options {
+    const char* rom_path = nullptr;
+    bool scan_compressed = false;
+    bool call_graph = false;
+    bool stats = false;
+    bool perf = false;
+};
 
-    rom_file.seekg(0, std::ios::end);
-    rom_size = rom_file.tellg();
-    rom_file.seekg(0, std::ios::beg);
+// Parse the command line into `options`, returning false if it's invalid
+bool parse_args(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
 
-    ret.resize(nearest_multiple_up<sizeof(uint32_t)>(rom_size));
-    rom_file.read(reinterpret_cast<char*>(ret.data()), rom_size);
-
-    if (rom_file.bad()) {
-        fmt::print(stderr, "Failed to read rom file {}\n", path);
-        exit(EXIT_FAILURE);
-    }
-
-    // Check rom endianness
-    uint32_t first_word = *reinterpret_cast<uint32_t*>(ret.data());
-    bool host_little_endian = std::endian::native == std::endian::little;
-
-    if (first_word == 0x40123780) {
-        // rom is opposite of host endianness
-        fmt::print("Detected {} endian rom\n", host_little_endian ? "big" : "little");
-        // Byteswap rom to host order
-        for (size_t i = 0; i < ret.size(); i += instruction_size) {
-            *reinterpret_cast<uint32_t*>(ret.data() + i) = byteswap(read32(ret, i));
+        if (arg == "--compressed") {
+            options.scan_compressed = true;
+        } else if (arg == "--callgraph") {
+            options.call_graph = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--perf") {
+            options.stats = true;
+            options.perf = true;
+        } else if (arg.starts_with("--") || options.rom_path != nullptr) {
+            return false;
+        } else {
+            options.rom_path = argv[i];
         }
-    } else if (first_word == 0x12408037 || first_word == 0x37804012) {
-        fmt::print(stderr, "v64 (byteswapped) roms not supported\n");
-        exit(EXIT_FAILURE);
-    } else if (first_word == 0x80371240) {
-        // rom is already in host endianness
-        fmt::print("Detected {} endian rom\n", host_little_endian ? "little" : "big");
-    } else {
-        fmt::print(stderr, "File is not an N64 game: {}\n", path);
-        exit(EXIT_FAILURE);
     }
 
-    return ret;
+    return options.rom_path != nullptr;
+}
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [rom]\n", program_name);
+    fmt::print("Options:\n");
+    fmt::print("  --compressed   Decompress Yay0, Yaz0 and MIO0 blocks and search them for code too\n");
+    fmt::print("  --callgraph    Print the call graph between the functions in all code regions\n");
+    fmt::print("  --stats        Print the time and throughput of each phase of the scan\n");
+    fmt::print("  --perf         Like --stats, and also record hardware performance counters for each phase (Linux only)\n");
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fmt::print("Usage: {} [rom]\n", argv[0]);
+    Options options{};
+    if (!parse_args(argc, argv, options)) {
+        print_usage(argv[0]);
         exit(EXIT_SUCCESS);
     }
 
-    const char* rom_path = argv[1]; 
+    scan_stats_enabled = options.stats;
+    perf_counters_enabled = options.perf;
+
+    const char* rom_path = options.rom_path;
     if (!std::filesystem::exists(rom_path)) {
         fmt::print(stderr, "No such file: {}\n", rom_path);
         exit(EXIT_FAILURE);
@@ -64,7 +67,23 @@ int main(int argc, char* argv[]) {
 
     std::vector<uint8_t> rom_bytes = read_rom(rom_path);
 
-    std::vector<RomRegion> code_regions = find_code_regions(rom_bytes);
+    std::vector<CompressedBlock> compressed_blocks{};
+    std::vector<RomRegion> code_regions = find_code_regions(rom_bytes, rom_code_start,
+        options.scan_compressed ? &compressed_blocks : nullptr);
+
+    CallGraph graph{};
+    if (options.call_graph) {
+        PhaseTimer timer{ScanPhase::analysis};
+        graph = build_call_graph(code_regions);
+    }
+
+    std::vector<CompressedCodeRegion> compressed_regions{};
+    if (options.scan_compressed) {
+        compressed_regions = scan_compressed_blocks(rom_bytes, compressed_blocks);
+    }
+
+    PhaseTimer output_timer{ScanPhase::output};
+
     fmt::print("Found {} code regions:\n", code_regions.size());
 
     for (const auto& codeseg : code_regions) {
@@ -72,16 +91,57 @@ int main(int argc, char* argv[]) {
         size_t end   = nearest_multiple_up<16>(codeseg.rom_end);
 
         if constexpr (!show_true_ranges) {
-            fmt::print("  0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {}\n",
-                start, end, end - start, codeseg.has_rsp);
+            fmt::print("  0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {} confidence: {:.2f}\n",
+                start, end, end - start, codeseg.has_rsp, codeseg.confidence);
         } else {
-            fmt::print("  0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {}\n",
-                codeseg.rom_start, codeseg.rom_end, codeseg.rom_end - codeseg.rom_start, codeseg.has_rsp);
+            fmt::print("  0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {} confidence: {:.2f}\n",
+                codeseg.rom_start, codeseg.rom_end, codeseg.rom_end - codeseg.rom_start, codeseg.has_rsp, codeseg.confidence);
             if (codeseg.rom_start != start) {
                 fmt::print("    Warn: code region doesn't start at 16 byte alignment");
             }
         }
+
+        if (codeseg.vram != 0) {
+            fmt::print("    vram: 0x{:08X} at rom 0x{:08X} (confidence {:.2f})\n", codeseg.vram, codeseg.rom_start, codeseg.vram_confidence);
+        }
+
+        for (const JumpTable& table : codeseg.jump_tables) {
+            bool inside = table.rom_start < codeseg.rom_end && table.rom_end > codeseg.rom_start;
+            fmt::print("    0x{:08X} to 0x{:08X} jump table (rodata) for jr at 0x{:08X}, vram 0x{:08X}{}\n",
+                table.rom_start, table.rom_end, table.jr_rom, table.vram, inside ? ", inside region" : "");
+        }
+    }
+
+    if (options.call_graph) {
+        size_t function_count = graph.function_starts.size();
+        fmt::print("Call graph: {} functions, {} edges, {} unresolved calls, {} ambiguous calls\n", function_count,
+            graph.callees.size(), graph.unresolved_calls, graph.ambiguous_calls);
+
+        for (size_t i = 0; i < function_count; i++) {
+            fmt::print("  0x{:08X} returns: {} calls:", graph.function_starts[i], graph.return_counts[i]);
+            for (size_t call = graph.call_offsets[i]; call < graph.call_offsets[i + 1]; call++) {
+                fmt::print(" 0x{:08X}", graph.function_starts[graph.callees[call]]);
+            }
+            fmt::print("\n");
+        }
+    }
+
+    if (options.scan_compressed) {
+        fmt::print("Found {} code regions in {} compressed blocks:\n", compressed_regions.size(), compressed_blocks.size());
+
+        for (const auto& compressed : compressed_regions) {
+            const RomRegion& codeseg = compressed.region;
+            fmt::print("  0x{:08X} ({}) + 0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {} confidence: {:.2f}\n",
+                compressed.container.rom_offset, compression_format_name(compressed.container.format),
+                codeseg.rom_start, codeseg.rom_end, codeseg.rom_end - codeseg.rom_start, codeseg.has_rsp, codeseg.confidence);
+        }
+    }
+
+    if (options.stats) {
+        // Stop the output timer before reporting, so output shows up in the stats
+        output_timer.stop();
+        print_scan_stats(collect_scan_stats());
     }
-    
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <span>
+
+#include "rabbitizer.hpp"
+
+#include "findcode.h"
+
+// Grow a region from each return address seed. Seeds inside of the previous candidate are skipped, since growing from
+// any seed inside of a region finds that same region.
+std::vector<RegionCandidate> grow_region_candidates(std::span<const uint8_t> rom_bytes, std::span<const size_t> seeds, size_t code_start,
+    const RomWordIndex& word_index)
+{
+    PhaseTimer timer{ScanPhase::region_growth};
+    std::vector<RegionCandidate> ret{};
+
+    for (size_t seed : seeds) {
+        if (!ret.empty() && seed < ret.back().rom_end) {
+            ret.back().last_seed = static_cast<uint32_t>(seed);
+            continue;
+        }
+
+        size_t region_start = find_code_start(rom_bytes, seed, code_start, word_index);
+        size_t region_end = find_code_end(rom_bytes, seed, word_index);
+        ret.push_back(RegionCandidate{
+            .rom_start = static_cast<uint32_t>(region_start),
+            .rom_end = static_cast<uint32_t>(region_end),
+            .last_seed = static_cast<uint32_t>(seed),
+        });
+        // Both walks decode every instruction in the region plus the invalid one that stopped them
+        timer.add_work(region_end - region_start, (region_end - region_start) / instruction_size + 2);
+    }
+
+    return ret;
+}
+
+// Sort candidates by start with an LSD radix sort on their 32-bit offsets, and combine duplicates from different producers
+void sort_region_candidates(std::vector<RegionCandidate>& candidates) {
+    constexpr size_t radix_bits = 8;
+    constexpr size_t bucket_count = size_t{1} << radix_bits;
+    std::vector<RegionCandidate> scratch(candidates.size());
+
+    for (uint32_t shift = 0; shift < 32; shift += radix_bits) {
+        std::array<size_t, bucket_count> offsets{};
+        for (const RegionCandidate& candidate : candidates) {
+            offsets[(candidate.rom_start >> shift) & (bucket_count - 1)]++;
+        }
+
+        // Every key has the same digit, so this pass wouldn't move anything
+        if (std::find(offsets.begin(), offsets.end(), candidates.size()) != offsets.end()) {
+            continue;
+        }
+
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+        for (const RegionCandidate& candidate : candidates) {
+            scratch[offsets[(candidate.rom_start >> shift) & (bucket_count - 1)]++] = candidate;
+        }
+        candidates.swap(scratch);
+    }
+
+    // Candidates with the same start were grown from seeds in the same region, so they're the same region
+    auto out = candidates.begin();
+    for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+        if (out != candidates.begin() && (out - 1)->rom_start == it->rom_start) {
+            (out - 1)->last_seed = std::max((out - 1)->last_seed, it->last_seed);
+        } else {
+            *out++ = *it;
+        }
+    }
+    candidates.erase(out, candidates.end());
+}
+
+// Trim every candidate in one pass, which must happen after sorting since duplicates are found by their grown start.
+// The trimmed bounds decide whether neighboring candidates merge, so this can't be deferred until after merging.
+void trim_region_candidates(std::span<const uint8_t> rom_bytes, std::span<RegionCandidate> candidates, const RomWordIndex& word_index) {
+    PhaseTimer timer{ScanPhase::trimming};
+    size_t decoded_count = 0;
+    size_t byte_count = 0;
+
+    for (RegionCandidate& candidate : candidates) {
+        size_t start = trim_region_start(candidate.rom_start, candidate.rom_end, rom_bytes, word_index);
+        size_t end = trim_region_end(start, candidate.rom_end, word_index);
+        // The start check decodes at most every instruction it skips plus the first valid one
+        decoded_count += (start - candidate.rom_start) / instruction_size + 1;
+        byte_count += candidate.rom_end - candidate.rom_start;
+        candidate.rom_start = static_cast<uint32_t>(start);
+        candidate.rom_end = static_cast<uint32_t>(end);
+    }
+
+    timer.add_work(byte_count, decoded_count);
+}
+
+// Turn sorted and trimmed candidates into regions in a single sweep: merge each one with the previous region if the gap
+// between them is valid CPU or RSP code, and extend regions with RSP code forward until the microcode ends
+std::vector<RomRegion> merge_region_candidates(std::span<const uint8_t> rom_bytes, std::span<const RegionCandidate> candidates,
+    const RomWordIndex& word_index)
+{
+    std::vector<RomRegion> ret{};
+
+    for (const RegionCandidate& candidate : candidates) {
+        // Skip candidates whose seeds are all inside of the previous region after its RSP extension. These were grown and
+        // trimmed for nothing, but growth can't be deferred to here since sorting and trimming need the grown bounds, and
+        // only regions next to microcode are extended so this is a handful of candidates per ROM.
+        if (!ret.empty() && candidate.last_seed < ret.back().rom_end) {
+            continue;
+        }
+
+        ret.emplace_back(candidate.rom_start, candidate.rom_end);
+
+        // If the current region is close enough to the previous region, check if there's valid RSP microcode between the two
+        // An overlap with the previous region wraps around to a huge gap, so overlapping regions are never merged
+        if (ret.size() > 1 && ret.back().rom_start - ret[ret.size() - 2].rom_end < microcode_check_threshold) {
+            PhaseTimer timer{ScanPhase::gap_checks};
+            size_t gap_size = ret.back().rom_start - ret[ret.size() - 2].rom_end;
+            timer.add_work(gap_size, gap_size / instruction_size);
+            // Check if there's a range of valid CPU instructions between these two regions
+            bool valid_range = check_range_cpu(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes, word_index);
+            // If there isn't check for RSP instructions
+            if (!valid_range) {
+                valid_range = check_range_rsp(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes, word_index);
+                timer.add_work(0, gap_size / instruction_size);
+                // If RSP instructions were found, mark the first region as having RSP instructions
+                if (valid_range) {
+                    ret[ret.size() - 2].has_rsp = true;
+                }
+            }
+            if (valid_range) {
+                // If there is, merge the two regions
+                size_t new_end = ret.back().rom_end;
+                ret.pop_back();
+                ret.back().rom_end = new_end;
+            }
+        }
+
+        // If the region has microcode, search forward until valid RSP instructions end
+        if (ret.back().has_rsp) {
+            // Keep advancing the region's end until either the stop point is reached or something
+            // that isn't a valid RSP instruction is seen
+            {
+                PhaseTimer timer{ScanPhase::rsp_extension};
+                size_t extension_start = ret.back().rom_end;
+                auto fill = find_next_fill(word_index, extension_start);
+                while (ret.back().rom_end < rom_bytes.size()) {
+                    // Jump over fill that's valid microcode, since every word of it would pass
+                    if (fill != word_index.fills.end() && ret.back().rom_end >= fill->rom_start) {
+                        bool rsp_valid = fill->rsp_valid;
+                        size_t fill_end = fill->rom_end;
+                        ++fill;
+                        if (rsp_valid) {
+                            ret.back().rom_end = fill_end;
+                            continue;
+                        }
+                    }
+                    if (!is_valid_rsp({read32(rom_bytes, ret.back().rom_end), 0})) {
+                        break;
+                    }
+                    ret.back().rom_end += instruction_size;
+                }
+                timer.add_work(ret.back().rom_end - extension_start, (ret.back().rom_end - extension_start) / instruction_size + 1);
+            }
+
+            // Trim the region's end again to get rid of any junk that may have been found after it.
+            // The start was already trimmed, and trimming it again can't move it unless nops are allowed as a start.
+            if (rule_enabled(RejectRule::start_nop)) {
+                PhaseTimer timer{ScanPhase::trimming};
+                ret.back().rom_end = trim_region_end(ret.back().rom_start, ret.back().rom_end, word_index);
+            } else {
+                trim_region(ret.back(), rom_bytes, word_index);
+            }
+        }
+    }
+
+    return ret;
+}
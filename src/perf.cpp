@@ -0,0 +1,175 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "findcode.h"
+
+bool perf_counters_enabled = false;
+
+// Bitmask of the counters that opened on at least one thread
+std::atomic<uint32_t> available_perf_counters = 0;
+
+// Reason the first failed counter group couldn't be opened
+std::mutex perf_error_mutex{};
+std::string perf_error{};
+
+void set_perf_error(std::string_view error) {
+    std::lock_guard lock{perf_error_mutex};
+    if (perf_error.empty()) {
+        perf_error = error;
+    }
+}
+
+#ifdef __linux__
+
+// Event type and config for each counter
+struct PerfEventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr uint64_t cache_miss_config(uint64_t cache, uint64_t op) {
+    return cache | (op << 8) | (static_cast<uint64_t>(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+}
+
+constexpr std::array<PerfEventConfig, perf_counter_count> perf_event_configs{{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cache_miss_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ)},
+    {PERF_TYPE_HW_CACHE, cache_miss_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ)},
+    {PERF_TYPE_HW_CACHE, cache_miss_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ)},
+}};
+
+// One group of counters for the calling thread, so every counter can be read with a single syscall
+class PerfCounterGroup {
+public:
+    PerfCounterGroup() {
+        member_index_.fill(-1);
+
+        for (size_t i = 0; i < perf_counter_count; i++) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = perf_event_configs[i].type;
+            attr.config = perf_event_configs[i].config;
+            attr.read_format = PERF_FORMAT_GROUP;
+            // Only count user mode, which is allowed at the default perf_event_paranoid level
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_fd_, 0));
+            if (fd < 0) {
+                // Without the first counter there's no group to add the others to
+                if (leader_fd_ < 0) {
+                    set_perf_error(std::strerror(errno));
+                    return;
+                }
+                continue;
+            }
+
+            if (leader_fd_ < 0) {
+                leader_fd_ = fd;
+            } else {
+                member_fds_.push_back(fd);
+            }
+            member_index_[i] = static_cast<int>(member_count_++);
+            available_perf_counters.fetch_or(1U << i, std::memory_order_relaxed);
+        }
+    }
+
+    ~PerfCounterGroup() {
+        for (int fd : member_fds_) {
+            close(fd);
+        }
+        if (leader_fd_ >= 0) {
+            close(leader_fd_);
+        }
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    bool read(PerfCounterValues& values) {
+        if (leader_fd_ < 0) {
+            return false;
+        }
+
+        // The group read format is the number of counters followed by each counter's value
+        std::array<uint64_t, perf_counter_count + 1> buffer{};
+        ssize_t expected = static_cast<ssize_t>((member_count_ + 1) * sizeof(uint64_t));
+        if (::read(leader_fd_, buffer.data(), sizeof(buffer)) != expected) {
+            return false;
+        }
+
+        for (size_t i = 0; i < perf_counter_count; i++) {
+            values[i] = member_index_[i] >= 0 ? buffer[1 + static_cast<size_t>(member_index_[i])] : 0;
+        }
+        return true;
+    }
+
+private:
+    int leader_fd_ = -1;
+    std::vector<int> member_fds_{};
+    // Position of each counter in the group, or -1 if it couldn't be opened
+    std::array<int, perf_counter_count> member_index_{};
+    size_t member_count_ = 0;
+};
+
+// Read the current thread's hardware performance counters, opening them on first use.
+// Returns false if none of the counters are available, e.g. on platforms other than Linux.
+bool read_perf_counters(PerfCounterValues& values) {
+    thread_local PerfCounterGroup group{};
+    return group.read(values);
+}
+
+#else
+
+// Read the current thread's hardware performance counters, opening them on first use.
+// Returns false if none of the counters are available, e.g. on platforms other than Linux.
+bool read_perf_counters(PerfCounterValues& values) {
+    (void)values;
+    set_perf_error("hardware counters are only supported on Linux");
+    return false;
+}
+
+#endif
+
+// Check if a given hardware performance counter could be opened on any thread
+bool perf_counter_available(PerfCounter counter) {
+    return (available_perf_counters.load(std::memory_order_relaxed) >> static_cast<uint32_t>(counter)) & 1;
+}
+
+// Why the hardware performance counters couldn't be opened, or an empty string if they could
+std::string_view perf_counters_error() {
+    std::lock_guard lock{perf_error_mutex};
+    return perf_error;
+}
+
+const char* perf_counter_name(PerfCounter counter) {
+    switch (counter) {
+        case PerfCounter::cycles:
+            return "cycles";
+        case PerfCounter::instructions:
+            return "instructions";
+        case PerfCounter::branch_misses:
+            return "branch misses";
+        case PerfCounter::l1d_misses:
+            return "L1D misses";
+        case PerfCounter::llc_misses:
+            return "LLC misses";
+        case PerfCounter::dtlb_misses:
+            return "dTLB misses";
+        case PerfCounter::count:
+            break;
+    }
+    return "unknown";
+}
@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+
+// Read a rom file from the given path and swap it (if necessary) to host endianness, without printing or exiting
+bool load_rom(const char* path, std::vector<uint8_t>& rom_bytes, bool& swapped, std::string& error) {
+    size_t rom_size;
+    std::ifstream rom_file{path, std::ios::binary};
+    rom_bytes.clear();
+    swapped = false;
+
+    if (!rom_file) {
+        error = fmt::format("Failed to open rom file {}", path);
+        return false;
+    }
+
+    {
+        PhaseTimer timer{ScanPhase::read_rom};
+        rom_file.seekg(0, std::ios::end);
+        rom_size = rom_file.tellg();
+        rom_file.seekg(0, std::ios::beg);
+
+        rom_bytes.resize(nearest_multiple_up<sizeof(uint32_t)>(rom_size));
+        rom_file.read(reinterpret_cast<char*>(rom_bytes.data()), rom_size);
+        timer.add_work(rom_size, 0);
+    }
+
+    if (rom_file.bad()) {
+        error = fmt::format("Failed to read rom file {}", path);
+        return false;
+    }
+
+    if (rom_bytes.size() < sizeof(uint32_t)) {
+        error = fmt::format("File is not an N64 game: {}", path);
+        return false;
+    }
+
+    // Check rom endianness
+    uint32_t first_word = *reinterpret_cast<uint32_t*>(rom_bytes.data());
+
+    if (first_word == 0x40123780) {
+        // rom is opposite of host endianness, so byteswap it to host order
+        PhaseTimer timer{ScanPhase::endian_normalization};
+        for (size_t i = 0; i < rom_bytes.size(); i += instruction_size) {
+            *reinterpret_cast<uint32_t*>(rom_bytes.data() + i) = byteswap(read32(rom_bytes, i));
+        }
+        timer.add_work(rom_bytes.size(), 0);
+        swapped = true;
+    } else if (first_word == 0x12408037 || first_word == 0x37804012) {
+        error = "v64 (byteswapped) roms not supported";
+        return false;
+    } else if (first_word != 0x80371240) {
+        error = fmt::format("File is not an N64 game: {}", path);
+        return false;
+    }
+
+    return true;
+}
+
+// Read a rom file from the given path and swap it (if necessary) to little-endian
+std::vector<uint8_t> read_rom(const char* path) {
+    std::vector<uint8_t> ret;
+    bool swapped;
+    std::string error;
+
+    if (!load_rom(path, ret, swapped, error)) {
+        fmt::print(stderr, "{}\n", error);
+        exit(EXIT_FAILURE);
+    }
+
+    bool host_little_endian = std::endian::native == std::endian::little;
+    fmt::print("Detected {} endian rom\n", host_little_endian != swapped ? "little" : "big");
+
+    return ret;
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <mutex>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+
+bool scan_stats_enabled = false;
+thread_local uint64_t disabled_rules = 0;
+
+thread_local ScanStats current_thread_stats{};
+// The current thread's allocation counters as of its last merge
+thread_local AllocationCounters merged_thread_allocations{};
+
+// Totals from threads that have finished scanning
+std::mutex merged_stats_mutex{};
+ScanStats merged_stats{};
+
+void ScanStats::merge(const ScanStats& other) {
+    for (size_t i = 0; i < scan_phase_count; i++) {
+        phases[i].nanoseconds += other.phases[i].nanoseconds;
+        phases[i].calls += other.phases[i].calls;
+        phases[i].bytes += other.phases[i].bytes;
+        phases[i].instructions += other.phases[i].instructions;
+        for (size_t counter = 0; counter < perf_counter_count; counter++) {
+            phases[i].counters[counter] += other.phases[i].counters[counter];
+        }
+        phases[i].allocations.count += other.phases[i].allocations.count;
+        phases[i].allocations.bytes += other.phases[i].allocations.bytes;
+    }
+
+    allocations.count += other.allocations.count;
+    allocations.bytes += other.allocations.bytes;
+    cpu_checks += other.cpu_checks;
+    rsp_checks += other.rsp_checks;
+    for (size_t i = 0; i < reject_rule_count; i++) {
+        rejections[i] += other.rejections[i];
+    }
+}
+
+// Stats recorded by the probes running on the current thread
+ScanStats& thread_scan_stats() {
+    return current_thread_stats;
+}
+
+// Add the current thread's stats to the process totals and reset them, for when a scanning thread finishes
+void merge_thread_scan_stats() {
+    if (!scan_stats_enabled && !rule_counters) {
+        return;
+    }
+
+    AllocationCounters thread_allocations = thread_allocation_counters();
+    current_thread_stats.allocations.count += thread_allocations.count - merged_thread_allocations.count;
+    current_thread_stats.allocations.bytes += thread_allocations.bytes - merged_thread_allocations.bytes;
+    merged_thread_allocations = thread_allocations;
+
+    std::lock_guard lock{merged_stats_mutex};
+    merged_stats.merge(current_thread_stats);
+    current_thread_stats = ScanStats{};
+}
+
+// Merge the current thread's stats and return the process totals
+ScanStats collect_scan_stats() {
+    merge_thread_scan_stats();
+    std::lock_guard lock{merged_stats_mutex};
+    return merged_stats;
+}
+
+const char* scan_phase_name(ScanPhase phase) {
+    switch (phase) {
+        case ScanPhase::read_rom:
+            return "read_rom";
+        case ScanPhase::endian_normalization:
+            return "endian normalization";
+        case ScanPhase::word_index:
+            return "word index";
+        case ScanPhase::find_return_locations:
+            return "find_return_locations";
+        case ScanPhase::region_growth:
+            return "region growth";
+        case ScanPhase::trimming:
+            return "trimming";
+        case ScanPhase::gap_checks:
+            return "CPU/RSP gap checks";
+        case ScanPhase::rsp_extension:
+            return "RSP extension";
+        case ScanPhase::analysis:
+            return "analysis";
+        case ScanPhase::output:
+            return "output";
+        case ScanPhase::count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* reject_rule_name(RejectRule rule) {
+    switch (rule) {
+        case RejectRule::invalid_opcode:
+            return "invalid opcode";
+        case RejectRule::zero_base:
+            return "$zero base";
+        case RejectRule::zero_output:
+            return "$zero output";
+        case RejectRule::cop0_register:
+            return "cop0 register";
+        case RejectRule::unused_n64_instruction:
+            return "unused N64 instruction";
+        case RejectRule::cache_params:
+            return "cache params";
+        case RejectRule::cop2_load_store:
+            return "cop2 load/store";
+        case RejectRule::trap:
+            return "trap";
+        case RejectRule::ctc0_cfc0:
+            return "ctc0/cfc0";
+        case RejectRule::pref:
+            return "pref";
+        case RejectRule::rsp_invalid_opcode:
+            return "rsp invalid opcode";
+        case RejectRule::rsp_invalid_bits:
+            return "rsp invalid bits";
+        case RejectRule::rsp_zero_output:
+            return "rsp $zero output";
+        case RejectRule::rsp_cop0_register:
+            return "rsp cop0 register";
+        case RejectRule::rsp_nonexistent_instruction:
+            return "rsp nonexistent instruction";
+        case RejectRule::start_nop:
+            return "start nop";
+        case RejectRule::start_invalid:
+            return "start invalid";
+        case RejectRule::start_zero_output:
+            return "start $zero output";
+        case RejectRule::start_uninitialized_read:
+            return "start uninitialized read";
+        case RejectRule::start_unconditional_branch:
+            return "start unconditional branch";
+        case RejectRule::start_linked_jump:
+            return "start linked jump";
+        case RejectRule::start_jr_zero:
+            return "start jr $zero";
+        case RejectRule::start_zero_shift:
+            return "start shift of $zero";
+        case RejectRule::start_mthi_mtlo:
+            return "start mthi/mtlo";
+        case RejectRule::start_cop1_branch:
+            return "start cop1 branch";
+        case RejectRule::start_trapping_arithmetic:
+            return "start add/sub/addi";
+        case RejectRule::start_ra_base:
+            return "start $ra base";
+        case RejectRule::identical_load_store:
+            return "identical load/store";
+        case RejectRule::count:
+            break;
+    }
+    return "unknown";
+}
+
+// Print how many words each validity rule rejected
+void print_rule_counters(const ScanStats& stats) {
+    fmt::print("Rejections ({} CPU checks, {} RSP checks):\n", stats.cpu_checks, stats.rsp_checks);
+    for (size_t i = 0; i < reject_rule_count; i++) {
+        RejectRule rule = static_cast<RejectRule>(i);
+        // Start instruction and range rules aren't applied to every checked word, so only show their count
+        if (rule >= RejectRule::start_nop) {
+            fmt::print("  {:<28} {:>12}\n", reject_rule_name(rule), stats.rejections[i]);
+            continue;
+        }
+        uint64_t checks = rule < RejectRule::rsp_invalid_opcode ? stats.cpu_checks : stats.rsp_checks;
+        double percent = checks != 0 ? 100.0 * static_cast<double>(stats.rejections[i]) / static_cast<double>(checks) : 0.0;
+        fmt::print("  {:<28} {:>12} {:>7.2f}%\n", reject_rule_name(rule), stats.rejections[i], percent);
+    }
+}
+
+// Print the IPC and misses per word of each phase
+void print_perf_counters(const ScanStats& stats) {
+    if (!perf_counter_available(PerfCounter::cycles)) {
+        fmt::print("Hardware counters unavailable: {}\n", perf_counters_error());
+        return;
+    }
+
+    fmt::print("Hardware counters (per word):\n");
+    fmt::print("  {:<22} {:>8}", "phase", "IPC");
+    for (size_t counter = 0; counter < perf_counter_count; counter++) {
+        if (static_cast<PerfCounter>(counter) != PerfCounter::instructions) {
+            fmt::print(" {:>14}", perf_counter_name(static_cast<PerfCounter>(counter)));
+        }
+    }
+    fmt::print("\n");
+
+    for (size_t i = 0; i < scan_phase_count; i++) {
+        const PhaseStats& phase = stats.phases[i];
+        if (phase.calls == 0) {
+            continue;
+        }
+
+        double cycles = static_cast<double>(phase.counters[static_cast<size_t>(PerfCounter::cycles)]);
+        double instructions = static_cast<double>(phase.counters[static_cast<size_t>(PerfCounter::instructions)]);
+        double words = static_cast<double>(std::max<uint64_t>(phase.bytes / instruction_size, 1));
+
+        fmt::print("  {:<22}", scan_phase_name(static_cast<ScanPhase>(i)));
+        if (perf_counter_available(PerfCounter::instructions) && cycles > 0.0) {
+            fmt::print(" {:>8.2f}", instructions / cycles);
+        } else {
+            fmt::print(" {:>8}", "n/a");
+        }
+        for (size_t counter = 0; counter < perf_counter_count; counter++) {
+            PerfCounter id = static_cast<PerfCounter>(counter);
+            if (id == PerfCounter::instructions) {
+                continue;
+            }
+            if (perf_counter_available(id)) {
+                fmt::print(" {:>14.4f}", static_cast<double>(phase.counters[counter]) / words);
+            } else {
+                fmt::print(" {:>14}", "n/a");
+            }
+        }
+        fmt::print("\n");
+    }
+}
+
+// Print the allocations made by each phase and the process's peak memory use
+void print_memory_stats(const ScanStats& stats) {
+    constexpr double megabyte = 1024.0 * 1024.0;
+    fmt::print("Memory:\n");
+    if constexpr (!allocation_counters) {
+        fmt::print("  peak RSS: {:.2f} MB (build with ALLOC_COUNTERS=1 for allocations per phase)\n",
+            static_cast<double>(peak_rss_bytes()) / megabyte);
+        return;
+    }
+    fmt::print("  {:<22} {:>12} {:>12}\n", "phase", "allocations", "MB");
+
+    AllocationCounters unattributed = stats.allocations;
+    for (size_t i = 0; i < scan_phase_count; i++) {
+        const AllocationCounters& allocations = stats.phases[i].allocations;
+        unattributed.count -= std::min(unattributed.count, allocations.count);
+        unattributed.bytes -= std::min(unattributed.bytes, allocations.bytes);
+        fmt::print("  {:<22} {:>12} {:>12.2f}\n", scan_phase_name(static_cast<ScanPhase>(i)),
+            allocations.count, static_cast<double>(allocations.bytes) / megabyte);
+    }
+
+    fmt::print("  {:<22} {:>12} {:>12.2f}\n", "outside of phases", unattributed.count, static_cast<double>(unattributed.bytes) / megabyte);
+    fmt::print("  {:<22} {:>12} {:>12.2f}\n", "total", stats.allocations.count, static_cast<double>(stats.allocations.bytes) / megabyte);
+    fmt::print("  peak RSS: {:.2f} MB\n", static_cast<double>(peak_rss_bytes()) / megabyte);
+}
+
+// Print per-phase time and throughput
+void print_scan_stats(const ScanStats& stats) {
+    fmt::print("Stats:\n");
+    fmt::print("  {:<22} {:>8} {:>11} {:>10} {:>10} {:>13} {:>10}\n",
+        "phase", "calls", "time (ms)", "MB", "MB/s", "instructions", "Minstr/s");
+
+    uint64_t total_nanoseconds = 0;
+    for (size_t i = 0; i < scan_phase_count; i++) {
+        const PhaseStats& phase = stats.phases[i];
+        total_nanoseconds += phase.nanoseconds;
+
+        double seconds = static_cast<double>(phase.nanoseconds) / 1e9;
+        double megabytes = static_cast<double>(phase.bytes) / (1024.0 * 1024.0);
+        double instructions = static_cast<double>(phase.instructions);
+        fmt::print("  {:<22} {:>8} {:>11.3f} {:>10.2f} {:>10.1f} {:>13} {:>10.1f}\n",
+            scan_phase_name(static_cast<ScanPhase>(i)), phase.calls, seconds * 1e3, megabytes,
+            seconds > 0.0 ? megabytes / seconds : 0.0, phase.instructions,
+            seconds > 0.0 ? instructions / seconds / 1e6 : 0.0);
+    }
+
+    fmt::print("  {:<22} {:>8} {:>11.3f}\n", "total", "", static_cast<double>(total_nanoseconds) / 1e6);
+
+    print_memory_stats(stats);
+
+    if (perf_counters_enabled) {
+        print_perf_counters(stats);
+    }
+
+    if constexpr (rule_counters) {
+        print_rule_counters(stats);
+    }
+}
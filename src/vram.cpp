@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+#include "findcode.h"
+
+// Number of distinct jal targets sampled to generate candidate load addresses
+constexpr size_t vram_sample_targets = 32;
+// Minimum number of jal targets that have to land on a function start for a load address to be reported
+constexpr size_t vram_min_votes = 3;
+
+// Walk a region, collecting function starts, calls, returns and addresses built from HI/LO register pairs
+RegionReferences collect_region_references(const RomRegion& region, std::span<const uint8_t> rom_bytes) {
+    RegionReferences ret{};
+
+    // The upper half loaded into each register by a lui, valid if the register's bit is set in `hi_valid`
+    std::array<uint32_t, 32> hi_values{};
+    uint32_t hi_valid = 0;
+    bool function_start = true;
+
+    size_t rom_addr = region.rom_start;
+    while (rom_addr < region.rom_end) {
+        uint32_t word = read32(rom_bytes, rom_addr);
+
+        // Functions start at the first non-nop after a return's delay slot
+        if (function_start && word != 0) {
+            ret.function_starts.push_back(rom_addr);
+            ret.return_counts.push_back(0);
+            function_start = false;
+        }
+
+        uint32_t opcode = instr_opcode(word);
+        uint32_t rs = instr_rs(word);
+        uint32_t rt = instr_rt(word);
+        bool rs_has_hi = (hi_valid >> rs) & 1;
+
+        if (opcode == opcode_lui) {
+            hi_values[rt] = (word & 0xFFFF) << 16;
+            hi_valid |= 1U << rt;
+        } else if (opcode == opcode_jal) {
+            uint32_t target = code_pointer_min | instr_target(word);
+            ret.jal_targets.push_back(target);
+            if (!ret.function_starts.empty()) {
+                ret.calls.push_back(RegionCall{
+                    .caller = ret.function_starts.size() - 1,
+                    .target = target,
+                });
+            }
+        } else if (opcode == opcode_addiu && rs_has_hi) {
+            ret.pair_addresses.push_back(hi_values[rs] + static_cast<uint32_t>(instr_simm(word)));
+            hi_valid &= ~(1U << rt);
+        } else if (opcode == opcode_ori && rs_has_hi) {
+            ret.pair_addresses.push_back(hi_values[rs] | (word & 0xFFFF));
+            hi_valid &= ~(1U << rt);
+        } else if (uint32_t output = raw_output_gpr(word); output != 0) {
+            // Any other write ends the pair, including loads that use it as a base
+            hi_valid &= ~(1U << output);
+        }
+
+        if (word == jr_ra) {
+            if (!ret.return_counts.empty()) {
+                ret.return_counts.back()++;
+            }
+            // Skip the delay slot and start tracking a new function
+            rom_addr += instruction_size;
+            function_start = true;
+            hi_valid = 0;
+        }
+
+        rom_addr += instruction_size;
+    }
+
+    // Only distinct targets matter for voting
+    for (std::vector<uint32_t>* addresses : {&ret.jal_targets, &ret.pair_addresses}) {
+        std::sort(addresses->begin(), addresses->end());
+        addresses->erase(std::unique(addresses->begin(), addresses->end()), addresses->end());
+    }
+
+    return ret;
+}
+
+// Infer the vram address a region is loaded at, by finding the load address that maps the most `jal` targets and
+// lui/addiu function pointers onto function starts in the region
+void infer_region_vram(RomRegion& region, const RegionReferences& refs) {
+    region.vram = 0;
+    region.vram_confidence = 0.0f;
+
+    if (refs.jal_targets.empty() || refs.function_starts.empty()) {
+        return;
+    }
+
+    // Generate candidate offsets (vram - rom) by pairing a sample of jal targets with every function start
+    std::unordered_map<int64_t, size_t> votes{};
+    size_t sample_stride = std::max<size_t>(1, refs.jal_targets.size() / vram_sample_targets);
+    for (size_t i = 0; i < refs.jal_targets.size(); i += sample_stride) {
+        for (size_t start : refs.function_starts) {
+            votes[static_cast<int64_t>(refs.jal_targets[i]) - static_cast<int64_t>(start)]++;
+        }
+    }
+
+    int64_t best_delta = 0;
+    size_t best_votes = 0;
+    for (const auto& [delta, count] : votes) {
+        uint32_t base = static_cast<uint32_t>(static_cast<int64_t>(region.rom_start) + delta);
+        if (count > best_votes && is_code_pointer(base)) {
+            best_delta = delta;
+            best_votes = count;
+        }
+    }
+
+    if (best_votes == 0) {
+        return;
+    }
+
+    // Score the best candidate against every reference, not just the sample
+    auto lands_on_function = [&refs, best_delta](uint32_t vram) {
+        int64_t rom_addr = static_cast<int64_t>(vram) - best_delta;
+        return rom_addr >= 0 && std::binary_search(refs.function_starts.begin(), refs.function_starts.end(), static_cast<size_t>(rom_addr));
+    };
+
+    size_t jal_hits = std::count_if(refs.jal_targets.begin(), refs.jal_targets.end(), lands_on_function);
+    size_t pointer_hits = std::count_if(refs.pair_addresses.begin(), refs.pair_addresses.end(), lands_on_function);
+
+    if (jal_hits < vram_min_votes) {
+        return;
+    }
+
+    // jal targets and pointers outside the region are references to other segments or data, so the confidence is
+    // relative to the ones that would land inside the region at this address
+    uint32_t region_vram_start = static_cast<uint32_t>(static_cast<int64_t>(region.rom_start) + best_delta);
+    uint32_t region_vram_end = static_cast<uint32_t>(static_cast<int64_t>(region.rom_end) + best_delta);
+    auto in_region = [=](uint32_t vram) {
+        return vram >= region_vram_start && vram < region_vram_end;
+    };
+    size_t jals_in_region = std::count_if(refs.jal_targets.begin(), refs.jal_targets.end(), in_region);
+    size_t pointers_in_region = std::count_if(refs.pair_addresses.begin(), refs.pair_addresses.end(), in_region);
+
+    region.vram = region_vram_start;
+    region.vram_confidence = static_cast<float>(jal_hits + pointer_hits) / static_cast<float>(jals_in_region + pointers_in_region);
+}
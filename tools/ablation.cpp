@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+#include "ranges.h"
+#include "synthrom.h"
+
+constexpr size_t default_seed_count = 4;
+constexpr size_t default_synthetic_size = 4 * 1024 * 1024;
+constexpr size_t default_repetitions = 3;
+
+struct CorpusRom {
+    std::string name;
+    std::vector<uint8_t> bytes;
+};
+
+// Output of scanning one rom with one set of rules disabled
+struct ScanResult {
+    double seconds = 0.0;
+    size_t region_count = 0;
+    std::vector<ByteRange> coverage{};
+};
+
+// Totals for one disabled rule across the corpus
+struct RuleSummary {
+    RejectRule rule;
+    double seconds = 0.0;
+    int64_t region_delta = 0;
+    size_t changed_roms = 0;
+    // Bytes that are only found with the rule disabled, and bytes that are only found with it enabled
+    size_t gained_bytes = 0;
+    size_t lost_bytes = 0;
+};
+
+// Scan a rom with the given rules disabled, keeping the fastest of several repetitions
+ScanResult scan_with_rules(std::span<const uint8_t> rom_bytes, uint64_t rule_mask, size_t repetitions) {
+    ScanResult ret{};
+    disabled_rules = rule_mask;
+
+    for (size_t rep = 0; rep < repetitions; rep++) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<RomRegion> regions = find_code_regions(rom_bytes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (rep == 0 || seconds < ret.seconds) {
+            ret.seconds = seconds;
+        }
+        if (rep == 0) {
+            ret.region_count = regions.size();
+            ret.coverage = region_coverage(regions);
+        }
+    }
+
+    disabled_rules = 0;
+    return ret;
+}
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [roms...]\n", program_name);
+    fmt::print("Disables each heuristic rule in turn and reports the scan time it saves and how much it changes the output.\n");
+    fmt::print("Options:\n");
+    fmt::print("  --seeds N        Number of synthetic roms to include in the corpus (default {})\n", default_seed_count);
+    fmt::print("  --size N         Size of each synthetic rom in bytes (default {})\n", default_synthetic_size);
+    fmt::print("  --repetitions N  Scans of each rom per rule, keeping the fastest (default {})\n", default_repetitions);
+    fmt::print("  --jobs N         Number of scans to run in parallel (default: number of cores, 1 gives the steadiest times)\n");
+}
+
+int main(int argc, char* argv[]) {
+    if constexpr (!rule_ablation) {
+        fmt::print(stderr, "Rule ablation isn't enabled in this build, rebuild with ABLATION=1\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t seed_count = default_seed_count;
+    size_t synthetic_size = default_synthetic_size;
+    size_t repetitions = default_repetitions;
+    size_t jobs = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    std::vector<const char*> rom_paths{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--seeds" && has_value) {
+            seed_count = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--size" && has_value) {
+            synthetic_size = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--repetitions" && has_value) {
+            repetitions = std::max<size_t>(std::strtoull(argv[++i], nullptr, 0), 1);
+        } else if (arg == "--jobs" && has_value) {
+            jobs = std::max<size_t>(std::strtoull(argv[++i], nullptr, 0), 1);
+        } else if (arg.starts_with("--")) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            rom_paths.push_back(argv[i]);
+        }
+    }
+
+    std::vector<CorpusRom> corpus{};
+    for (uint64_t seed = 1; seed <= seed_count; seed++) {
+        SynthRom rom = generate_synthetic_rom(SynthRomOptions{.seed = seed, .size = synthetic_size});
+        corpus.push_back(CorpusRom{fmt::format("synthetic seed {}", seed), std::move(rom.bytes)});
+    }
+    for (const char* rom_path : rom_paths) {
+        if (!std::filesystem::exists(rom_path)) {
+            fmt::print(stderr, "No such file: {}\n", rom_path);
+            return EXIT_FAILURE;
+        }
+        corpus.push_back(CorpusRom{rom_path, read_rom(rom_path)});
+    }
+    if (corpus.empty()) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Configuration 0 is the baseline with every rule enabled, configuration i disables rule i - 1
+    size_t config_count = reject_rule_count + 1;
+    std::vector<ScanResult> results(config_count * corpus.size());
+    std::atomic<size_t> next_job = 0;
+    std::vector<std::thread> threads{};
+
+    for (size_t i = 0; i < std::min(jobs, results.size()); i++) {
+        threads.emplace_back([&] {
+            while (true) {
+                size_t job = next_job.fetch_add(1, std::memory_order_relaxed);
+                if (job >= results.size()) {
+                    break;
+                }
+                size_t config = job / corpus.size();
+                uint64_t rule_mask = config == 0 ? 0 : (uint64_t{1} << (config - 1));
+                results[job] = scan_with_rules(corpus[job % corpus.size()].bytes, rule_mask, repetitions);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    double baseline_seconds = 0.0;
+    size_t baseline_regions = 0;
+    for (size_t rom = 0; rom < corpus.size(); rom++) {
+        baseline_seconds += results[rom].seconds;
+        baseline_regions += results[rom].region_count;
+    }
+
+    std::vector<RuleSummary> summaries{};
+    for (size_t config = 1; config < config_count; config++) {
+        RuleSummary& summary = summaries.emplace_back(RuleSummary{static_cast<RejectRule>(config - 1)});
+        for (size_t rom = 0; rom < corpus.size(); rom++) {
+            const ScanResult& baseline = results[rom];
+            const ScanResult& ablated = results[config * corpus.size() + rom];
+            size_t common = intersection_bytes(baseline.coverage, ablated.coverage);
+            size_t gained = total_bytes(ablated.coverage) - common;
+            size_t lost = total_bytes(baseline.coverage) - common;
+
+            summary.seconds += ablated.seconds;
+            summary.region_delta += static_cast<int64_t>(ablated.region_count) - static_cast<int64_t>(baseline.region_count);
+            summary.gained_bytes += gained;
+            summary.lost_bytes += lost;
+            summary.changed_roms += (gained != 0 || lost != 0 || ablated.region_count != baseline.region_count);
+        }
+    }
+
+    // Rules that save the most time when disabled first
+    std::sort(summaries.begin(), summaries.end(), [](const RuleSummary& a, const RuleSummary& b) { return a.seconds < b.seconds; });
+
+    fmt::print("Baseline: {} roms, {} regions, {:.2f} ms\n", corpus.size(), baseline_regions, baseline_seconds * 1e3);
+    fmt::print("{:<28} {:>11} {:>9} {:>9} {:>8} {:>12} {:>12}\n",
+        "disabled rule", "time (ms)", "saved", "regions", "roms", "bytes gained", "bytes lost");
+    for (const RuleSummary& summary : summaries) {
+        double saved = baseline_seconds > 0.0 ? (baseline_seconds - summary.seconds) / baseline_seconds : 0.0;
+        fmt::print("{:<28} {:>11.2f} {:>+8.2f}% {:>+9} {:>8} {:>12} {:>12}\n",
+            reject_rule_name(summary.rule), summary.seconds * 1e3, saved * 100.0, summary.region_delta,
+            summary.changed_roms, summary.gained_bytes, summary.lost_bytes);
+    }
+
+    return EXIT_SUCCESS;
+}
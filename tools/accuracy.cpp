@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+#include "ranges.h"
+#include "splat.h"
+
+// A rom and the ground truth segment map for it
+struct CorpusEntry {
+    std::string rom_path;
+    std::string map_path;
+};
+
+struct AccuracyResult {
+    bool valid = false;
+    std::string error{};
+    size_t rom_size = 0;
+    double scan_seconds = 0.0;
+    size_t region_count = 0;
+    // Bytes found by findcode that are code in the map, bytes found by findcode, and code bytes in the map
+    size_t true_positive_bytes = 0;
+    size_t predicted_bytes = 0;
+    size_t truth_bytes = 0;
+    // Each region found and how many of its bytes are code in the map
+    std::vector<RomRegion> regions{};
+    std::vector<size_t> region_true_bytes{};
+};
+
+double ratio(size_t num, size_t den) {
+    return den != 0 ? static_cast<double>(num) / static_cast<double>(den) : 0.0;
+}
+
+double f1_score(double precision, double recall) {
+    return (precision + recall) > 0.0 ? 2.0 * precision * recall / (precision + recall) : 0.0;
+}
+
+// Scan one rom and score the regions found against its map
+AccuracyResult evaluate(const CorpusEntry& entry) {
+    AccuracyResult ret{};
+
+    std::vector<TruthRange> truth{};
+    if (!read_splat_map(entry.map_path.c_str(), truth)) {
+        ret.error = fmt::format("Failed to read segment map {}", entry.map_path);
+        return ret;
+    }
+
+    // This runs on a worker thread, so a bad rom fails this entry instead of exiting
+    std::vector<uint8_t> rom_bytes{};
+    bool swapped;
+    if (!load_rom(entry.rom_path.c_str(), rom_bytes, swapped, ret.error)) {
+        return ret;
+    }
+    ret.rom_size = rom_bytes.size();
+
+    auto start = std::chrono::steady_clock::now();
+    ret.regions = find_code_regions(rom_bytes);
+    ret.scan_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ret.region_count = ret.regions.size();
+
+    std::vector<ByteRange> truth_code{};
+    for (const TruthRange& range : truth) {
+        if (range.is_code) {
+            truth_code.push_back(ByteRange{range.rom_start, std::min(range.rom_end, rom_bytes.size())});
+        }
+    }
+    truth_code = merge_ranges(std::move(truth_code));
+
+    for (const RomRegion& region : ret.regions) {
+        ret.region_true_bytes.push_back(intersection_bytes({ByteRange{region.rom_start, region.rom_end}}, truth_code));
+    }
+    std::vector<ByteRange> predicted = region_coverage(ret.regions);
+
+    ret.true_positive_bytes = intersection_bytes(predicted, truth_code);
+    ret.predicted_bytes = total_bytes(predicted);
+    ret.truth_bytes = total_bytes(truth_code);
+    ret.valid = true;
+    return ret;
+}
+
+// Find every rom in a directory that has a segment map with the same name next to it
+std::vector<CorpusEntry> find_corpus_entries(const std::filesystem::path& dir) {
+    std::vector<CorpusEntry> ret{};
+    for (const auto& file : std::filesystem::directory_iterator{dir}) {
+        std::filesystem::path path = file.path();
+        std::string extension = path.extension().string();
+        if (extension != ".z64" && extension != ".n64") {
+            continue;
+        }
+        for (std::string_view map_extension : {".yaml", ".yml"}) {
+            std::filesystem::path map_path = path;
+            map_path.replace_extension(map_extension);
+            if (std::filesystem::exists(map_path)) {
+                ret.push_back(CorpusEntry{path.string(), map_path.string()});
+                break;
+            }
+        }
+    }
+    std::sort(ret.begin(), ret.end(), [](const CorpusEntry& a, const CorpusEntry& b) { return a.rom_path < b.rom_path; });
+    return ret;
+}
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [rom map]...\n", program_name);
+    fmt::print("Scores findcode's output against ground truth splat segment maps at byte granularity, next to its throughput.\n");
+    fmt::print("Options:\n");
+    fmt::print("  --dir DIR   Also score every rom in DIR (.z64 or .n64) that has a .yaml or .yml map with the same name\n");
+    fmt::print("  --jobs N    Number of roms to scan in parallel (default: number of cores, 1 gives the steadiest throughput)\n");
+    fmt::print("  --regions   Print the precision of each region found\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<CorpusEntry> corpus{};
+    size_t jobs = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    bool print_regions = false;
+    std::vector<const char*> positional{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) {
+            std::vector<CorpusEntry> entries = find_corpus_entries(argv[++i]);
+            corpus.insert(corpus.end(), entries.begin(), entries.end());
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            jobs = std::max<size_t>(std::strtoull(argv[++i], nullptr, 0), 1);
+        } else if (arg == "--regions") {
+            print_regions = true;
+        } else if (arg.starts_with("--")) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() % 2 != 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < positional.size(); i += 2) {
+        corpus.push_back(CorpusEntry{positional[i], positional[i + 1]});
+    }
+    if (corpus.empty()) {
+        print_usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    for (const CorpusEntry& entry : corpus) {
+        if (!std::filesystem::exists(entry.rom_path)) {
+            fmt::print(stderr, "No such file: {}\n", entry.rom_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Scan roms in parallel, each worker taking the next unscanned rom
+    std::vector<AccuracyResult> results(corpus.size());
+    std::atomic<size_t> next_entry = 0;
+    std::vector<std::thread> threads{};
+    for (size_t i = 0; i < std::min(jobs, corpus.size()); i++) {
+        threads.emplace_back([&] {
+            while (true) {
+                size_t index = next_entry.fetch_add(1, std::memory_order_relaxed);
+                if (index >= corpus.size()) {
+                    break;
+                }
+                results[index] = evaluate(corpus[index]);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    fmt::print("{:<40} {:>10} {:>10} {:>8} {:>8} {:>8} {:>10} {:>9}\n",
+        "rom", "size (MB)", "regions", "prec", "recall", "F1", "time (ms)", "MB/s");
+
+    size_t total_true_positive = 0;
+    size_t total_predicted = 0;
+    size_t total_truth = 0;
+    size_t total_size = 0;
+    double total_seconds = 0.0;
+    bool failed = false;
+
+    for (size_t i = 0; i < corpus.size(); i++) {
+        const AccuracyResult& result = results[i];
+        std::string name = std::filesystem::path{corpus[i].rom_path}.filename().string();
+        if (!result.valid) {
+            fmt::print("{:<40} {}\n", name, result.error);
+            failed = true;
+            continue;
+        }
+
+        double megabytes = static_cast<double>(result.rom_size) / (1024.0 * 1024.0);
+        double precision = ratio(result.true_positive_bytes, result.predicted_bytes);
+        double recall = ratio(result.true_positive_bytes, result.truth_bytes);
+        fmt::print("{:<40} {:>10.2f} {:>10} {:>8.4f} {:>8.4f} {:>8.4f} {:>10.2f} {:>9.1f}\n",
+            name, megabytes, result.region_count, precision, recall, f1_score(precision, recall),
+            result.scan_seconds * 1e3, result.scan_seconds > 0.0 ? megabytes / result.scan_seconds : 0.0);
+
+        if (print_regions) {
+            for (size_t region = 0; region < result.regions.size(); region++) {
+                const RomRegion& codeseg = result.regions[region];
+                fmt::print("  0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {} confidence: {:.2f} precision: {:.4f}\n",
+                    codeseg.rom_start, codeseg.rom_end, codeseg.rom_end - codeseg.rom_start, codeseg.has_rsp, codeseg.confidence,
+                    ratio(result.region_true_bytes[region], codeseg.rom_end - codeseg.rom_start));
+            }
+        }
+
+        total_true_positive += result.true_positive_bytes;
+        total_predicted += result.predicted_bytes;
+        total_truth += result.truth_bytes;
+        total_size += result.rom_size;
+        total_seconds += result.scan_seconds;
+    }
+
+    // Totals weight every byte in the corpus equally, so larger roms count for more
+    double precision = ratio(total_true_positive, total_predicted);
+    double recall = ratio(total_true_positive, total_truth);
+    double megabytes = static_cast<double>(total_size) / (1024.0 * 1024.0);
+    fmt::print("{:<40} {:>10.2f} {:>10} {:>8.4f} {:>8.4f} {:>8.4f} {:>10.2f} {:>9.1f}\n",
+        "total", megabytes, "", precision, recall, f1_score(precision, recall),
+        total_seconds * 1e3, total_seconds > 0.0 ? megabytes / total_seconds : 0.0);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "fmt/format.h"
+
+// Default slowdown that counts as a regression, in percent
+constexpr double default_threshold_percent = 5.0;
+// A change also has to be larger than this many scaled MADs to not be noise
+constexpr double noise_mads = 3.0;
+// Scales a MAD to estimate the standard deviation of normally distributed samples
+constexpr double mad_scale = 1.4826;
+
+// Just enough JSON to read benchmark results
+struct JsonValue {
+    enum class Type {
+        null,
+        boolean,
+        number,
+        string,
+        array,
+        object,
+    };
+
+    Type type = Type::null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string{};
+    std::vector<JsonValue> array{};
+    std::vector<std::pair<std::string, JsonValue>> object{};
+
+    const JsonValue* find(std::string_view key) const {
+        for (const auto& [name, value] : object) {
+            if (name == key) {
+                return &value;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : text_(text) {}
+
+    std::optional<JsonValue> parse() {
+        std::optional<JsonValue> ret = parse_value();
+        skip_whitespace();
+        if (pos_ != text_.size()) {
+            return std::nullopt;
+        }
+        return ret;
+    }
+
+private:
+    void skip_whitespace() {
+        while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    bool consume(char c) {
+        skip_whitespace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_literal(std::string_view literal) {
+        if (text_.substr(pos_, literal.size()) == literal) {
+            pos_ += literal.size();
+            return true;
+        }
+        return false;
+    }
+
+    std::optional<std::string> parse_string() {
+        if (!consume('"')) {
+            return std::nullopt;
+        }
+        std::string ret{};
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c == '\\' && pos_ < text_.size()) {
+                char escaped = text_[pos_++];
+                switch (escaped) {
+                    case 'n': ret += '\n'; break;
+                    case 't': ret += '\t'; break;
+                    case 'r': ret += '\r'; break;
+                    case 'b': ret += '\b'; break;
+                    case 'f': ret += '\f'; break;
+                    // Benchmark names are ASCII, so \u escapes are kept as-is
+                    case 'u': ret += "\\u"; break;
+                    default: ret += escaped; break;
+                }
+            } else {
+                ret += c;
+            }
+        }
+        if (pos_ >= text_.size()) {
+            return std::nullopt;
+        }
+        pos_++;
+        return ret;
+    }
+
+    std::optional<JsonValue> parse_value() {
+        skip_whitespace();
+        if (pos_ >= text_.size()) {
+            return std::nullopt;
+        }
+
+        JsonValue ret{};
+        char c = text_[pos_];
+        if (c == '{') {
+            pos_++;
+            ret.type = JsonValue::Type::object;
+            if (consume('}')) {
+                return ret;
+            }
+            do {
+                skip_whitespace();
+                std::optional<std::string> key = parse_string();
+                if (!key || !consume(':')) {
+                    return std::nullopt;
+                }
+                std::optional<JsonValue> value = parse_value();
+                if (!value) {
+                    return std::nullopt;
+                }
+                ret.object.emplace_back(std::move(*key), std::move(*value));
+            } while (consume(','));
+            return consume('}') ? std::optional{ret} : std::nullopt;
+        }
+        if (c == '[') {
+            pos_++;
+            ret.type = JsonValue::Type::array;
+            if (consume(']')) {
+                return ret;
+            }
+            do {
+                std::optional<JsonValue> value = parse_value();
+                if (!value) {
+                    return std::nullopt;
+                }
+                ret.array.push_back(std::move(*value));
+            } while (consume(','));
+            return consume(']') ? std::optional{ret} : std::nullopt;
+        }
+        if (c == '"') {
+            std::optional<std::string> str = parse_string();
+            if (!str) {
+                return std::nullopt;
+            }
+            ret.type = JsonValue::Type::string;
+            ret.string = std::move(*str);
+            return ret;
+        }
+        if (consume_literal("true") || consume_literal("false")) {
+            ret.type = JsonValue::Type::boolean;
+            ret.boolean = c == 't';
+            return ret;
+        }
+        if (consume_literal("null")) {
+            return ret;
+        }
+
+        // Number
+        std::string number{};
+        while (pos_ < text_.size() && std::string_view{"+-0123456789.eE"}.find(text_[pos_]) != std::string_view::npos) {
+            number += text_[pos_++];
+        }
+        char* end = nullptr;
+        ret.type = JsonValue::Type::number;
+        ret.number = std::strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0') {
+            return std::nullopt;
+        }
+        return ret;
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+// One benchmark's repetitions from a results file
+struct BenchSamples {
+    std::string name;
+    // What the samples are per, "word" or "call"
+    std::string unit;
+    std::vector<double> samples;
+};
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return (values.size() % 2 == 0) ? (values[mid - 1] + values[mid]) / 2.0 : values[mid];
+}
+
+// Median absolute deviation from the median
+double median_absolute_deviation(const std::vector<double>& values) {
+    double center = median(values);
+    std::vector<double> deviations{};
+    for (double value : values) {
+        deviations.push_back(std::abs(value - center));
+    }
+    return median(deviations);
+}
+
+// Read the output of `findcode_bench --json`, returning false if the file isn't valid
+bool read_bench_results(const char* path, std::vector<BenchSamples>& results) {
+    std::ifstream file{path};
+    if (!file) {
+        fmt::print(stderr, "Failed to open {}\n", path);
+        return false;
+    }
+    std::string text{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+
+    std::optional<JsonValue> root = JsonParser{text}.parse();
+    const JsonValue* benchmarks = root ? root->find("benchmarks") : nullptr;
+    if (benchmarks == nullptr || benchmarks->type != JsonValue::Type::array) {
+        fmt::print(stderr, "{} isn't a benchmark results file\n", path);
+        return false;
+    }
+
+    for (const JsonValue& benchmark : benchmarks->array) {
+        const JsonValue* name = benchmark.find("name");
+        std::string_view unit = "word";
+        const JsonValue* samples = benchmark.find("samples_ns_per_word");
+        if (samples == nullptr) {
+            unit = "call";
+            samples = benchmark.find("samples_ns_per_call");
+        }
+        if (name == nullptr || samples == nullptr || samples->type != JsonValue::Type::array || samples->array.empty()) {
+            fmt::print(stderr, "{} has a benchmark without samples\n", path);
+            return false;
+        }
+
+        BenchSamples& result = results.emplace_back(BenchSamples{name->string, std::string{unit}, {}});
+        for (const JsonValue& sample : samples->array) {
+            result.samples.push_back(sample.number);
+        }
+    }
+
+    return true;
+}
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [baseline json] [new json]\n", program_name);
+    fmt::print("Compares two `findcode_bench --json` outputs and exits with an error if any benchmark got slower.\n");
+    fmt::print("A benchmark regresses if its median slows down by more than the threshold and by more than {} scaled MADs\n", noise_mads);
+    fmt::print("of the repetitions in either run, so run the benchmarks with several repetitions.\n");
+    fmt::print("Options:\n");
+    fmt::print("  --threshold PCT  Slowdown that counts as a regression, in percent (default {})\n", default_threshold_percent);
+}
+
+int main(int argc, char* argv[]) {
+    double threshold_percent = default_threshold_percent;
+    std::vector<const char*> paths{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--threshold" && i + 1 < argc) {
+            threshold_percent = std::strtod(argv[++i], nullptr);
+        } else if (arg.starts_with("--")) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.size() != 2) {
+        print_usage(argv[0]);
+        return paths.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::vector<BenchSamples> baseline{};
+    std::vector<BenchSamples> current{};
+    if (!read_bench_results(paths[0], baseline) || !read_bench_results(paths[1], current)) {
+        return EXIT_FAILURE;
+    }
+
+    fmt::print("{:<40} {:>12} {:>12} {:>9} {:>9}  {}\n", "benchmark", "base ns/unit", "new ns/unit", "change", "noise", "result");
+
+    size_t regressions = 0;
+    for (const BenchSamples& base : baseline) {
+        auto match = std::find_if(current.begin(), current.end(), [&](const BenchSamples& bench) { return bench.name == base.name; });
+        if (match == current.end()) {
+            fmt::print("{:<40} {:>12.3f} {:>12} {:>9} {:>9}  missing\n", base.name, median(base.samples), "", "", "");
+            continue;
+        }
+
+        // Times per word and per call can't be compared
+        if (match->unit != base.unit) {
+            fmt::print("{:<40} {:>12.3f} {:>12.3f} {:>9} {:>9}  unit changed from {} to {}\n",
+                base.name, median(base.samples), median(match->samples), "", "", base.unit, match->unit);
+            continue;
+        }
+
+        double base_median = median(base.samples);
+        double new_median = median(match->samples);
+        double change = base_median > 0.0 ? (new_median - base_median) / base_median : 0.0;
+        // Noise is the larger spread of the two runs, relative to the baseline
+        double spread = mad_scale * std::max(median_absolute_deviation(base.samples), median_absolute_deviation(match->samples));
+        double noise = base_median > 0.0 ? noise_mads * spread / base_median : 0.0;
+        bool enough_samples = base.samples.size() >= 3 && match->samples.size() >= 3;
+
+        std::string_view result = "ok";
+        if (change * 100.0 > threshold_percent) {
+            if (change > noise) {
+                result = enough_samples ? "REGRESSION" : "REGRESSION (too few repetitions to judge noise)";
+                regressions++;
+            } else {
+                result = "noisy";
+            }
+        } else if (-change * 100.0 > threshold_percent && -change > noise) {
+            result = "faster";
+        }
+
+        fmt::print("{:<40} {:>12.3f} {:>12.3f} {:>+8.1f}% {:>8.1f}%  {}\n",
+            base.name, base_median, new_median, change * 100.0, noise * 100.0, result);
+    }
+
+    for (const BenchSamples& bench : current) {
+        bool in_baseline = std::any_of(baseline.begin(), baseline.end(), [&](const BenchSamples& base) { return base.name == bench.name; });
+        if (!in_baseline) {
+            fmt::print("{:<40} {:>12} {:>12.3f} {:>9} {:>9}  new\n", bench.name, "", median(bench.samples), "", "");
+        }
+    }
+
+    if (regressions != 0) {
+        fmt::print("{} benchmarks regressed by more than {}%\n", regressions, threshold_percent);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,58 @@
+#include <algorithm>
+
+#include "ranges.h"
+
+// Sort ranges and merge any that overlap or touch
+std::vector<ByteRange> merge_ranges(std::vector<ByteRange> ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) { return a.start < b.start; });
+    std::vector<ByteRange> ret{};
+    for (const ByteRange& range : ranges) {
+        if (range.end <= range.start) {
+            continue;
+        }
+        if (!ret.empty() && range.start <= ret.back().end) {
+            ret.back().end = std::max(ret.back().end, range.end);
+        } else {
+            ret.push_back(range);
+        }
+    }
+    return ret;
+}
+
+// The bytes covered by a list of regions, as sorted and disjoint ranges
+std::vector<ByteRange> region_coverage(const std::vector<RomRegion>& regions) {
+    std::vector<ByteRange> ranges{};
+    ranges.reserve(regions.size());
+    for (const RomRegion& region : regions) {
+        ranges.push_back(ByteRange{region.rom_start, region.rom_end});
+    }
+    return merge_ranges(std::move(ranges));
+}
+
+// Number of bytes in both of two sorted, disjoint range lists
+size_t intersection_bytes(const std::vector<ByteRange>& a, const std::vector<ByteRange>& b) {
+    size_t ret = 0;
+    size_t a_index = 0;
+    size_t b_index = 0;
+    while (a_index < a.size() && b_index < b.size()) {
+        size_t start = std::max(a[a_index].start, b[b_index].start);
+        size_t end = std::min(a[a_index].end, b[b_index].end);
+        if (end > start) {
+            ret += end - start;
+        }
+        if (a[a_index].end < b[b_index].end) {
+            a_index++;
+        } else {
+            b_index++;
+        }
+    }
+    return ret;
+}
+
+size_t total_bytes(const std::vector<ByteRange>& ranges) {
+    size_t ret = 0;
+    for (const ByteRange& range : ranges) {
+        ret += range.end - range.start;
+    }
+    return ret;
+}
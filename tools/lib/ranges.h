@@ -0,0 +1,26 @@
+#ifndef __RANGES_H__
+#define __RANGES_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "findcode.h"
+
+// A half-open byte range
+struct ByteRange {
+    size_t start;
+    size_t end;
+};
+
+// Sort ranges and merge any that overlap or touch
+std::vector<ByteRange> merge_ranges(std::vector<ByteRange> ranges);
+
+// The bytes covered by a list of regions, as sorted and disjoint ranges
+std::vector<ByteRange> region_coverage(const std::vector<RomRegion>& regions);
+
+// Number of bytes in both of two sorted, disjoint range lists
+size_t intersection_bytes(const std::vector<ByteRange>& a, const std::vector<ByteRange>& b);
+
+size_t total_bytes(const std::vector<ByteRange>& ranges);
+
+#endif
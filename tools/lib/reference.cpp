@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <span>
+
+#include "rabbitizer.hpp"
+
+#include "findcode.h"
+#include "reference.h"
+
+// A frozen copy of the straightforward region search, used by `regress` to check that optimizations of
+// `find_code_regions` don't change its results. Only the parts of the search that are being optimized are copied,
+// the rest (instruction validity, jump table and vram analysis) is shared with the production path. Nothing here may
+// use the rom word index, since that's what the optimized path is built on.
+// Don't change this to match new behavior unless that behavior change is intended.
+
+// Search a span for any instances of the instruction `jr $ra`, starting at `code_start`
+std::vector<size_t> reference_find_return_locations(std::span<const uint8_t> rom_bytes, size_t code_start) {
+    std::vector<size_t> ret{};
+    ret.reserve(1024);
+
+    std::vector<uint8_t> plausible_blocks{};
+    if (entropy_filter) {
+        plausible_blocks = find_plausible_code_blocks(rom_bytes);
+    }
+
+    for (size_t rom_addr = code_start; rom_addr < rom_bytes.size(); rom_addr += instruction_size) {
+        // Skip blocks that don't look like code. The previous block also has to fail the check, since a function
+        // that ends near the start of a block is mostly in the previous one.
+        if (entropy_filter && rom_addr % entropy_block_size == 0) {
+            size_t block_index = rom_addr / entropy_block_size;
+            bool prev_plausible = block_index > 0 && plausible_blocks[block_index - 1];
+            if (!plausible_blocks[block_index] && !prev_plausible) {
+                size_t block_end = std::min(rom_addr + entropy_block_size, rom_bytes.size());
+                rom_addr = block_end - instruction_size;
+                continue;
+            }
+        }
+
+        uint32_t rom_word = *reinterpret_cast<const uint32_t*>(rom_bytes.data() + rom_addr);
+
+        if (rom_word == jr_ra) {
+            // Found a jr $ra, make sure the delay slot is also a valid instruction and if so mark this as a code region
+            uint32_t next_word = *reinterpret_cast<const uint32_t*>(rom_bytes.data() + rom_addr + instruction_size);
+
+            // This may be microcode, so check instruction validity for both CPU and RSP
+            rabbitizer::InstructionCpu next_instr_cpu{next_word, 0};
+            rabbitizer::InstructionRsp next_instr_rsp{next_word, 0};
+            if (is_valid(next_instr_cpu) || is_valid_rsp(next_instr_rsp)) {
+                ret.push_back(rom_addr);
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Searches backwards from the given rom address until it hits an invalid instruction or `code_start`
+size_t reference_find_code_start(std::span<const uint8_t> rom_bytes, size_t rom_addr, size_t code_start) {
+    while (rom_addr > code_start) {
+        size_t cur_rom_addr = rom_addr - instruction_size;
+        rabbitizer::InstructionCpu cur_instr{read32(rom_bytes, cur_rom_addr), 0};
+
+        if (!is_valid(cur_instr)) {
+            return rom_addr;
+        }
+
+        rom_addr = cur_rom_addr;
+    }
+
+    return rom_addr;
+}
+
+// Searches forwards from the given rom address until it hits an invalid instruction
+size_t reference_find_code_end(std::span<const uint8_t> rom_bytes, size_t rom_addr) {
+    while (rom_addr > 0) {
+        rabbitizer::InstructionCpu cur_instr{read32(rom_bytes, rom_addr), 0};
+
+        if (!is_valid(cur_instr)) {
+            return rom_addr;
+        }
+
+        rom_addr += instruction_size;
+    }
+
+    return rom_addr;
+}
+
+// Check if a given instruction word is an unconditional non-linking branch (i.e. `b`, `j`, or `jr`)
+bool reference_is_unconditional_branch(uint32_t instruction_word) {
+    rabbitizer::InstructionCpu instr{instruction_word, 0};
+    InstrId id = instr.getUniqueId();
+
+    return id == InstrId::cpu_b || id == InstrId::cpu_j || id == InstrId::cpu_jr;
+}
+
+// Trims zeroes from the start of a code region and "loose" instructions from the end
+void reference_trim_region(RomRegion& codeseg, std::span<const uint8_t> rom_bytes) {
+    size_t start = codeseg.rom_start;
+    size_t end = codeseg.rom_end;
+    size_t invalid_start_count = count_invalid_start_instructions(codeseg, rom_bytes);
+
+    start += invalid_start_count * instruction_size;
+    
+    // Remove leading nops
+    while (read32(rom_bytes, start) == 0 && end > start) {
+        start += instruction_size;
+    }
+    
+    // Any instruction that isn't eventually followed by an unconditional non-linking branch (b, j, jr) would run into
+    // invalid code, so scan backwards until we see an unconditional branch and remove anything after it.
+    // Scan two instructions back (8 bytes before the end) instead of one to include the delay slot.
+    while (!reference_is_unconditional_branch(read32(rom_bytes, end - 2 * instruction_size)) && end > start) {
+        end -= instruction_size;
+    }
+    
+    codeseg.rom_start = start;
+    codeseg.rom_end = end;
+}
+
+// Check if a given rom range is valid CPU instructions
+bool reference_check_range_cpu(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes) {
+    uint32_t prev_word = 0xFFFFFFFF;
+    int identical_count = 0;
+    for (size_t offset = rom_start; offset < rom_end; offset += instruction_size) {
+        uint32_t cur_word = read32(rom_bytes, offset);
+        // Check if the previous instruction is identical to this one
+        if (cur_word == prev_word) {
+            // If it is, increase the consecutive identical instruction count
+            identical_count++;
+        } else {
+            // Otherwise, reset the count and update the previous instruction for tracking
+            prev_word = cur_word;
+            identical_count = 0;
+        }
+        rabbitizer::InstructionCpu instr{cur_word, 0};
+        // If there are 3 identical loads or stores in a row, it's not likely to be real code
+        // Use 3 as the count because 2 could be plausible if it's a duplicated instruction by the compiler.
+        // Only check for loads and stores because arithmetic could be duplicated to avoid more expensive operations,
+        // e.g. x + x + x instead of 3 * x. 
+        if (identical_count >= 3 && (instr.doesLoad() || instr.doesStore())) {
+            return false;
+        }
+        if (!is_valid(instr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check if a given rom range is valid RSP instructions
+bool reference_check_range_rsp(size_t rom_start, size_t rom_end, std::span<const uint8_t> rom_bytes) {
+    uint32_t prev_word = 0xFFFFFFFF;
+    int identical_count = 0;
+    for (size_t offset = rom_start; offset < rom_end; offset += instruction_size) {
+        uint32_t cur_word = read32(rom_bytes, offset);
+        // Check if the previous instruction is identical to this one
+        if (cur_word == prev_word) {
+            // If it is, increase the consecutive identical instruction count
+            identical_count++;
+        } else {
+            // Otherwise, reset the count and update the previous instruction for tracking
+            prev_word = cur_word;
+            identical_count = 0;
+        }
+        rabbitizer::InstructionRsp instr{cur_word, 0};
+        // See `reference_check_range_cpu` for an explanation of this logic.
+        if (identical_count >= 3 && (instr.doesLoad() || instr.doesStore())) {
+            return false;
+        }
+        if (!is_valid_rsp(instr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<RomRegion> reference_find_code_regions(std::span<const uint8_t> rom_bytes, size_t code_start) {
+    std::vector<RomRegion> ret{};
+    
+    std::vector<size_t> return_addrs = reference_find_return_locations(rom_bytes, code_start);
+
+    auto it = return_addrs.begin();
+    while (it != return_addrs.end()) {
+        size_t region_start = reference_find_code_start(rom_bytes, *it, code_start);
+        size_t region_end = reference_find_code_end(rom_bytes, *it);
+        ret.emplace_back(region_start, region_end);
+        
+        while (it != return_addrs.end() && *it < ret.back().rom_end) {
+            it++;
+        }
+        
+        reference_trim_region(ret.back(), rom_bytes);
+        
+        // If the current region is close enough to the previous region, check if there's valid RSP microcode between the two
+        if (ret.size() > 1 && ret.back().rom_start - ret[ret.size() - 2].rom_end < microcode_check_threshold) {
+            // Check if there's a range of valid CPU instructions between these two regions
+            bool valid_range = reference_check_range_cpu(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes);
+            // If there isn't check for RSP instructions
+            if (!valid_range) {
+                valid_range = reference_check_range_rsp(ret[ret.size() - 2].rom_end, ret.back().rom_start, rom_bytes);
+                // If RSP instructions were found, mark the first region as having RSP instructions
+                if (valid_range) {
+                    ret[ret.size() - 2].has_rsp = true;
+                }
+            }
+            if (valid_range) {
+                // If there is, merge the two regions
+                size_t new_end = ret.back().rom_end;
+                ret.pop_back();
+                ret.back().rom_end = new_end;
+            }
+        }
+
+        // If the region has microcode, search forward until valid RSP instructions end
+        if (ret.back().has_rsp) {
+            // Keep advancing the region's end until either the stop point is reached or something
+            // that isn't a valid RSP instruction is seen
+            while (ret.back().rom_end < rom_bytes.size() && is_valid_rsp({read32(rom_bytes, ret.back().rom_end), 0})) {
+                ret.back().rom_end += instruction_size;
+            }
+
+            // Trim the region again to get rid of any junk that may have been found after its end
+            reference_trim_region(ret.back(), rom_bytes);
+
+            // Skip any return addresses that are now part of the region
+            while (it != return_addrs.end() && *it < ret.back().rom_end) {
+                it++;
+            }
+        }
+    }
+
+    // Find jump tables, which also links regions that were split apart within a function
+    // Finding the tables is shared with the production path, but the gaps are checked word by word like the merges above
+    link_jump_tables(ret, code_start, rom_bytes, [rom_bytes](size_t start, size_t end) {
+        return reference_check_range_cpu(start, end, rom_bytes);
+    });
+
+    // Score each region on how much its register usage looks like real code
+    for (RomRegion& region : ret) {
+        region.confidence = region_confidence(analyze_region_dataflow(region, rom_bytes));
+    }
+
+    // Infer where each region is loaded in memory
+    for (RomRegion& region : ret) {
+        region.references = collect_region_references(region, rom_bytes);
+        infer_region_vram(region, region.references);
+    }
+
+    return ret;
+}
@@ -0,0 +1,13 @@
+#ifndef __REFERENCE_H__
+#define __REFERENCE_H__
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "findcode.h"
+
+// Find all the regions of code in the given rom with the frozen reference implementation of `find_code_regions`
+std::vector<RomRegion> reference_find_code_regions(std::span<const uint8_t> rom_bytes, size_t code_start = rom_code_start);
+
+#endif
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <string_view>
+
+#include "splat.h"
+
+// Segment types that contain code. `code` isn't one, since it's a group whose subsegments (including data) carry their own types.
+constexpr std::array<std::string_view, 7> code_segment_types{
+    "asm", "hasm", "c", "cpp", "textbin", "lib", "rsp",
+};
+
+// A segment or subsegment in the map, which ends where the next one starts
+struct SplatEntry {
+    size_t rom_start = 0;
+    bool has_start = false;
+    std::string type{};
+    // Indentation of the entry's `-`, used to attach the keys of block style entries to it
+    size_t indent = 0;
+    bool subsegment = false;
+};
+
+std::string_view trim(std::string_view str) {
+    size_t start = str.find_first_not_of(" \t\r");
+    if (start == std::string_view::npos) {
+        return {};
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(start, end - start + 1);
+}
+
+// Remove a trailing comment, ignoring `#` inside of quotes
+std::string_view strip_comment(std::string_view line) {
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (quote != 0) {
+            quote = (c == quote) ? 0 : quote;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '#') {
+            return line.substr(0, i);
+        }
+    }
+    return line;
+}
+
+std::string_view unquote(std::string_view str) {
+    str = trim(str);
+    if (str.size() >= 2 && (str.front() == '"' || str.front() == '\'') && str.back() == str.front()) {
+        return str.substr(1, str.size() - 2);
+    }
+    return str;
+}
+
+bool parse_number(std::string_view str, size_t& value) {
+    std::string text{unquote(str)};
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    value = std::strtoull(text.c_str(), &end, 0);
+    return end != nullptr && *end == '\0';
+}
+
+// Split the contents of a flow collection (`[a, b]` or `{a: b}`) on top level commas
+std::vector<std::string_view> split_flow(std::string_view contents) {
+    std::vector<std::string_view> ret{};
+    int depth = 0;
+    size_t item_start = 0;
+    for (size_t i = 0; i < contents.size(); i++) {
+        char c = contents[i];
+        if (c == '[' || c == '{') {
+            depth++;
+        } else if (c == ']' || c == '}') {
+            depth--;
+        } else if (c == ',' && depth == 0) {
+            ret.push_back(trim(contents.substr(item_start, i - item_start)));
+            item_start = i + 1;
+        }
+    }
+    std::string_view last = trim(contents.substr(item_start));
+    if (!last.empty()) {
+        ret.push_back(last);
+    }
+    return ret;
+}
+
+// Apply a `key: value` pair to an entry
+void apply_key(SplatEntry& entry, std::string_view key, std::string_view value) {
+    key = unquote(key);
+    if (key == "start") {
+        entry.has_start = parse_number(value, entry.rom_start);
+    } else if (key == "type") {
+        entry.type = unquote(value);
+    }
+}
+
+// Parse the part of a list item after the `-`
+void parse_item(SplatEntry& entry, std::string_view item) {
+    if (item.starts_with('[') && item.ends_with(']')) {
+        // [start, type, name, ...]
+        std::vector<std::string_view> values = split_flow(item.substr(1, item.size() - 2));
+        if (!values.empty()) {
+            entry.has_start = parse_number(values[0], entry.rom_start);
+        }
+        if (values.size() > 1) {
+            entry.type = unquote(values[1]);
+        }
+    } else if (item.starts_with('{') && item.ends_with('}')) {
+        for (std::string_view pair : split_flow(item.substr(1, item.size() - 2))) {
+            size_t colon = pair.find(':');
+            if (colon != std::string_view::npos) {
+                apply_key(entry, pair.substr(0, colon), pair.substr(colon + 1));
+            }
+        }
+    } else if (size_t colon = item.find(':'); colon != std::string_view::npos) {
+        // The first key of a block style entry
+        apply_key(entry, item.substr(0, colon), item.substr(colon + 1));
+    } else {
+        entry.has_start = parse_number(item, entry.rom_start);
+    }
+}
+
+// Read the segments of a splat YAML file into ranges in rom order, with each range ending where the next starts.
+// Returns false if the file can't be read or has no segments.
+bool read_splat_map(const char* path, std::vector<TruthRange>& ranges) {
+    std::ifstream file{path};
+    if (!file) {
+        return false;
+    }
+
+    std::vector<SplatEntry> entries{};
+    bool in_segments = false;
+    bool in_subsegments = false;
+    size_t segment_indent = std::string_view::npos;
+    // Index of the last segment and subsegment entries, for attaching keys on later lines
+    size_t segment_index = std::string_view::npos;
+    size_t subsegment_index = std::string_view::npos;
+
+    std::string line_buffer{};
+    while (std::getline(file, line_buffer)) {
+        std::string_view line = strip_comment(line_buffer);
+        std::string_view content = trim(line);
+        if (content.empty()) {
+            continue;
+        }
+        size_t indent = line.find_first_not_of(' ');
+
+        // Only the top level `segments` key is read
+        if (indent == 0 && !content.starts_with('-')) {
+            in_segments = content == "segments:";
+            in_subsegments = false;
+            continue;
+        }
+        if (!in_segments) {
+            continue;
+        }
+
+        if (content.starts_with("- ") || content == "-") {
+            std::string_view item = trim(content.substr(1));
+            if (segment_indent == std::string_view::npos) {
+                segment_indent = indent;
+            }
+
+            SplatEntry entry{};
+            entry.indent = indent;
+            if (indent <= segment_indent) {
+                in_subsegments = false;
+                segment_index = entries.size();
+            } else if (in_subsegments) {
+                entry.subsegment = true;
+                subsegment_index = entries.size();
+            } else {
+                // A list under some other key of a segment
+                continue;
+            }
+            parse_item(entry, item);
+            entries.push_back(entry);
+            continue;
+        }
+
+        // A key of a block style entry, which belongs to the most recent entry that it's indented under
+        size_t colon = content.find(':');
+        if (colon == std::string_view::npos || segment_index == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = trim(content.substr(0, colon));
+        bool for_subsegment = in_subsegments && subsegment_index != std::string_view::npos &&
+            subsegment_index > segment_index && indent > entries[subsegment_index].indent;
+
+        if (for_subsegment) {
+            apply_key(entries[subsegment_index], key, content.substr(colon + 1));
+        } else {
+            if (key == "subsegments") {
+                in_subsegments = true;
+                subsegment_index = std::string_view::npos;
+            }
+            apply_key(entries[segment_index], key, content.substr(colon + 1));
+        }
+    }
+
+    // Subsegments without a start (e.g. bss) don't take up rom space
+    std::erase_if(entries, [](const SplatEntry& entry) { return !entry.has_start; });
+    if (entries.empty()) {
+        return false;
+    }
+
+    // Segments are listed in rom order, and a subsegment at the same offset as its segment overrides it
+    std::stable_sort(entries.begin(), entries.end(), [](const SplatEntry& a, const SplatEntry& b) {
+        return a.rom_start < b.rom_start;
+    });
+
+    ranges.clear();
+    for (size_t i = 0; i + 1 < entries.size(); i++) {
+        size_t end = entries[i + 1].rom_start;
+        if (end <= entries[i].rom_start) {
+            continue;
+        }
+        std::string_view type = entries[i].type;
+        // Section types of C files are written with a leading `.`
+        if (type.starts_with('.')) {
+            type.remove_prefix(1);
+        }
+        bool is_code = std::find(code_segment_types.begin(), code_segment_types.end(), type) != code_segment_types.end();
+        ranges.push_back(TruthRange{entries[i].rom_start, end, entries[i].type, is_code});
+    }
+
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef __SPLAT_H__
+#define __SPLAT_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A rom range from a ground truth segment map
+struct TruthRange {
+    size_t rom_start;
+    size_t rom_end;
+    // Segment type from the map, e.g. `asm`, `c` or `data`
+    std::string type;
+    bool is_code;
+};
+
+// Read the segments of a splat YAML file into ranges in rom order, with each range ending where the next starts.
+// Returns false if the file can't be read or has no segments.
+bool read_splat_map(const char* path, std::vector<TruthRange>& ranges);
+
+#endif
@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <string_view>
+
+#include "findcode.h"
+#include "synthrom.h"
+
+// Range of sizes for each segment type, in bytes
+struct SegmentSizeRange {
+    size_t min;
+    size_t max;
+};
+
+constexpr SegmentSizeRange code_segment_size{0x2000, 0x40000};
+constexpr SegmentSizeRange rsp_segment_size{0x400, 0x1000};
+constexpr SegmentSizeRange compressed_segment_size{0x4000, 0x80000};
+constexpr SegmentSizeRange padding_segment_size{0x100, 0x20000};
+constexpr SegmentSizeRange data_segment_size{0x400, 0x20000};
+
+// Alignment of segment starts
+constexpr size_t segment_alignment = 0x10;
+// Vram address of the first code segment
+constexpr uint32_t synth_vram_base = 0x80000400;
+
+// Deterministic generator (splitmix64), so roms are identical across platforms and standard libraries
+class SynthRng {
+public:
+    explicit SynthRng(uint64_t seed) : state_(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+    uint32_t next32() {
+        return static_cast<uint32_t>(next() >> 32);
+    }
+
+    // Uniform integer in [min, max]
+    size_t range(size_t min, size_t max) {
+        return min + static_cast<size_t>(next() % (max - min + 1));
+    }
+
+    // True with a probability of `num` in `den`
+    bool chance(uint64_t num, uint64_t den) {
+        return next() % den < num;
+    }
+
+    template <typename T, size_t N>
+    T pick(const std::array<T, N>& values) {
+        return values[range(0, N - 1)];
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Instruction encoders
+constexpr uint32_t encode_r(uint32_t rs, uint32_t rt, uint32_t rd, uint32_t sa, uint32_t funct) {
+    return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | funct;
+}
+
+constexpr uint32_t encode_i(uint32_t op, uint32_t rs, uint32_t rt, int32_t imm) {
+    return (op << 26) | (rs << 21) | (rt << 16) | (static_cast<uint32_t>(imm) & 0xFFFF);
+}
+
+constexpr uint32_t encode_j(uint32_t op, uint32_t target) {
+    return (op << 26) | ((target >> 2) & 0x03FFFFFF);
+}
+
+// Register numbers
+constexpr uint32_t r_zero = 0;
+constexpr uint32_t r_at = 1;
+constexpr uint32_t r_v0 = 2;
+constexpr uint32_t r_v1 = 3;
+constexpr uint32_t r_a0 = 4;
+constexpr uint32_t r_s0 = 16;
+constexpr uint32_t r_sp = 29;
+constexpr uint32_t r_ra = 31;
+constexpr uint32_t r_t6 = 14;
+constexpr std::array<uint32_t, 10> temp_regs{8, 9, 10, 11, 12, 13, 14, 15, 24, 25};
+
+constexpr uint32_t nop = 0;
+
+// Writes words to a rom in host word order
+class RomWriter {
+public:
+    RomWriter(std::vector<uint8_t>& bytes, size_t offset) : bytes_(bytes), offset_(offset) {}
+
+    void word(uint32_t value) {
+        *reinterpret_cast<uint32_t*>(bytes_.data() + offset_) = value;
+        offset_ += instruction_size;
+    }
+
+    // Writes a byte at its big-endian position, so byte streams read back correctly with `read8_be`
+    void byte_be(uint8_t value) {
+        size_t index = (std::endian::native == std::endian::little) ? (offset_ ^ 3) : offset_;
+        bytes_[index] = value;
+        offset_++;
+    }
+
+    size_t offset() const {
+        return offset_;
+    }
+
+private:
+    std::vector<uint8_t>& bytes_;
+    size_t offset_;
+};
+
+// Generates functions that look like compiler output: a stack frame, a body that only reads initialized registers,
+// and an epilogue returning through `jr $ra`
+class FunctionGenerator {
+public:
+    FunctionGenerator(SynthRng& rng, std::vector<uint32_t>& words, uint32_t vram_base) :
+        rng_(rng), words_(words), vram_base_(vram_base) {}
+
+    void generate() {
+        uint32_t start_vram = vram_base_ + static_cast<uint32_t>(words_.size() * instruction_size);
+        int32_t frame = static_cast<int32_t>(8 * rng_.range(3, 10));
+        live_ = {r_a0, r_a0 + 1, r_a0 + 2, r_a0 + 3, r_s0};
+        frame_size_ = frame;
+
+        // Prologue
+        emit(encode_i(0x09, r_sp, r_sp, -frame));       // addiu $sp, $sp, -frame
+        emit(encode_i(0x2B, r_sp, r_ra, frame - 4));    // sw    $ra, frame-4($sp)
+        emit(encode_i(0x2B, r_sp, r_s0, frame - 8));    // sw    $s0, frame-8($sp)
+        emit(encode_r(r_a0, r_zero, r_s0, 0, 0x25));    // move  $s0, $a0
+
+        size_t statements = rng_.range(4, 40);
+        for (size_t i = 0; i < statements; i++) {
+            statement();
+        }
+
+        // Epilogue
+        emit(encode_r(live_reg(), r_zero, r_v0, 0, 0x25)); // move  $v0, <live>
+        emit(encode_i(0x23, r_sp, r_s0, frame - 8));       // lw    $s0, frame-8($sp)
+        emit(encode_i(0x23, r_sp, r_ra, frame - 4));       // lw    $ra, frame-4($sp)
+        emit(jr_ra);                                       // jr    $ra
+        emit(encode_i(0x09, r_sp, r_sp, frame));           // addiu $sp, $sp, frame
+
+        // Pad to 16 bytes like most compilers do
+        while ((words_.size() * instruction_size) % 16 != 0) {
+            emit(nop);
+        }
+
+        function_vrams_.push_back(start_vram);
+    }
+
+private:
+    void emit(uint32_t word) {
+        words_.push_back(word);
+    }
+
+    uint32_t live_reg() {
+        return live_[rng_.range(0, live_.size() - 1)];
+    }
+
+    // Pick a temporary to write and mark it as live
+    uint32_t dest_reg() {
+        uint32_t reg = rng_.pick(temp_regs);
+        if (std::find(live_.begin(), live_.end(), reg) == live_.end()) {
+            live_.push_back(reg);
+        }
+        return reg;
+    }
+
+    int32_t stack_offset() {
+        return static_cast<int32_t>(4 * rng_.range(0, static_cast<size_t>(frame_size_ / 4) - 3));
+    }
+
+    void statement() {
+        switch (rng_.range(0, 9)) {
+            case 0: // lw <temp>, off($sp)
+                emit(encode_i(0x23, r_sp, dest_reg(), stack_offset()));
+                break;
+            case 1: // sw <live>, off($sp)
+                emit(encode_i(0x2B, r_sp, live_reg(), stack_offset()));
+                break;
+            case 2: { // addu/subu/and/or/xor/slt <temp>, <live>, <live>
+                constexpr std::array<uint32_t, 6> functs{0x21, 0x23, 0x24, 0x25, 0x26, 0x2A};
+                uint32_t rs = live_reg();
+                uint32_t rt = live_reg();
+                emit(encode_r(rs, rt, dest_reg(), 0, rng_.pick(functs)));
+                break;
+            }
+            case 3: { // addiu/andi/ori <temp>, <live>, imm
+                constexpr std::array<uint32_t, 3> ops{0x09, 0x0C, 0x0D};
+                uint32_t rs = live_reg();
+                emit(encode_i(rng_.pick(ops), rs, dest_reg(), static_cast<int32_t>(rng_.range(1, 0x100))));
+                break;
+            }
+            case 4: { // sll/srl/sra <temp>, <live>, sa
+                constexpr std::array<uint32_t, 3> functs{0x00, 0x02, 0x03};
+                uint32_t rt = live_reg();
+                emit(encode_r(r_zero, rt, dest_reg(), static_cast<uint32_t>(rng_.range(1, 31)), rng_.pick(functs)));
+                break;
+            }
+            case 5: { // lui/addiu pair and a load through it
+                uint32_t base = dest_reg();
+                uint32_t address = 0x80100000 + static_cast<uint32_t>(4 * rng_.range(0, 0x40000));
+                int32_t lo = static_cast<int16_t>(address & 0xFFFF);
+                uint32_t hi = (address - static_cast<uint32_t>(lo)) >> 16;
+                emit(encode_i(0x0F, r_zero, base, static_cast<int32_t>(hi)));
+                emit(encode_i(0x09, base, base, lo));
+                emit(encode_i(0x23, base, dest_reg(), 0));
+                break;
+            }
+            case 6: { // jal to an earlier function (or itself), with the argument set up in the delay slot
+                uint32_t target = function_vrams_.empty() ?
+                    vram_base_ : function_vrams_[rng_.range(0, function_vrams_.size() - 1)];
+                emit(encode_j(0x03, target));
+                emit(encode_r(live_reg(), r_zero, r_a0, 0, 0x25)); // move $a0, <live>
+                if (std::find(live_.begin(), live_.end(), r_v0) == live_.end()) {
+                    live_.push_back(r_v0);
+                }
+                break;
+            }
+            case 7: { // bnez <live>, skip the next instruction
+                emit(encode_i(0x05, live_reg(), r_zero, 2));
+                emit(nop);
+                uint32_t rs = live_reg();
+                emit(encode_i(0x09, rs, dest_reg(), 1));
+                break;
+            }
+            case 8: { // mult/mflo
+                uint32_t rs = live_reg();
+                uint32_t rt = live_reg();
+                emit(encode_r(rs, rt, 0, 0, 0x18));
+                emit(encode_r(0, 0, dest_reg(), 0, 0x12));
+                break;
+            }
+            case 9: { // lwc1/add.s/swc1 on the stack frame
+                int32_t offset = stack_offset();
+                emit(encode_i(0x31, r_sp, 4, offset));                 // lwc1  $f4, off($sp)
+                emit((0x11U << 26) | (0x10U << 21) | encode_r(0, 4, 4, 6, 0x00)); // add.s $f6, $f4, $f4
+                emit(encode_i(0x39, r_sp, 6, offset));                 // swc1  $f6, off($sp)
+                break;
+            }
+        }
+    }
+
+    SynthRng& rng_;
+    std::vector<uint32_t>& words_;
+    uint32_t vram_base_;
+    std::vector<uint32_t> live_;
+    std::vector<uint32_t> function_vrams_;
+    int32_t frame_size_ = 0;
+};
+
+// Generate a segment's worth of functions
+std::vector<uint32_t> generate_code(SynthRng& rng, size_t size, uint32_t vram_base) {
+    std::vector<uint32_t> words{};
+    FunctionGenerator generator{rng, words, vram_base};
+    while (words.size() * instruction_size < size) {
+        generator.generate();
+    }
+    words.resize(size / instruction_size, nop);
+    return words;
+}
+
+// Generate microcode-like RSP code: vector arithmetic, vector loads and stores, and scalar DMEM accesses
+std::vector<uint32_t> generate_rsp(SynthRng& rng, size_t size) {
+    std::vector<uint32_t> words{};
+    constexpr std::array<uint32_t, 6> vector_functs{0x07, 0x0F, 0x10, 0x11, 0x13, 0x20};
+    constexpr uint32_t imem_base = 0x04001000;
+
+    while (words.size() * instruction_size < size) {
+        uint32_t reg = static_cast<uint32_t>(rng.range(1, 27));
+        uint32_t vreg = static_cast<uint32_t>(rng.range(0, 31));
+        switch (rng.range(0, 4)) {
+            case 0:
+            case 1: // Vector op: cop2 with bit 25 set
+                words.push_back((0x12U << 26) | (1U << 25) | (static_cast<uint32_t>(rng.range(0, 15)) << 21) |
+                    (vreg << 16) | (static_cast<uint32_t>(rng.range(0, 31)) << 11) |
+                    (static_cast<uint32_t>(rng.range(0, 31)) << 6) | rng.pick(vector_functs));
+                break;
+            case 2: // lqv/sqv
+                words.push_back(((rng.chance(1, 2) ? 0x32U : 0x3AU) << 26) | (reg << 21) | (vreg << 16) | (0x04U << 11) |
+                    static_cast<uint32_t>(rng.range(0, 0x7F)));
+                break;
+            case 3: // lw/sw from DMEM
+                words.push_back(encode_i(rng.chance(1, 2) ? 0x23 : 0x2B, r_zero, reg, static_cast<int32_t>(4 * rng.range(0, 0x3FF))));
+                break;
+            case 4: // addi/andi on a scalar register, or a jump within IMEM
+                if (rng.chance(1, 8)) {
+                    words.push_back(encode_j(0x02, imem_base + static_cast<uint32_t>(4 * rng.range(0, 0x3FF))));
+                    words.push_back(nop);
+                } else {
+                    words.push_back(encode_i(rng.chance(1, 2) ? 0x08 : 0x0C, reg, reg, static_cast<int32_t>(rng.range(0, 0xFFF))));
+                }
+                break;
+        }
+    }
+
+    words.resize(size / instruction_size, nop);
+    return words;
+}
+
+// Generate data tables: floats, pointers, 16-bit pairs, small integers and strings
+void generate_data(SynthRng& rng, RomWriter& writer, size_t end) {
+    while (writer.offset() < end) {
+        size_t table_end = std::min(end, writer.offset() + 4 * rng.range(4, 256));
+        size_t kind = rng.range(0, 4);
+        while (writer.offset() < table_end) {
+            switch (kind) {
+                case 0:
+                    writer.word(std::bit_cast<uint32_t>(static_cast<float>(static_cast<int32_t>(rng.range(0, 200000)) - 100000) / 100.0f));
+                    break;
+                case 1:
+                    writer.word(0x80100000 + static_cast<uint32_t>(4 * rng.range(0, 0x40000)));
+                    break;
+                case 2:
+                    writer.word((static_cast<uint32_t>(rng.range(0, 0x3FF)) << 16) | static_cast<uint32_t>(rng.range(0, 0x3FF)));
+                    break;
+                case 3:
+                    writer.word(static_cast<uint32_t>(rng.range(0, 100)));
+                    break;
+                case 4:
+                    for (size_t i = 0; i < instruction_size; i++) {
+                        writer.byte_be(static_cast<uint8_t>(rng.chance(1, 12) ? 0 : rng.range(0x20, 0x7E)));
+                    }
+                    break;
+            }
+        }
+    }
+}
+
+// Generate compressed-looking data: either random bytes, or a Yaz0 block wrapping generated code
+void generate_compressed(SynthRng& rng, RomWriter& writer, size_t end, uint32_t vram_base) {
+    size_t size = end - writer.offset();
+
+    if (rng.chance(1, 2) && size >= 0x100) {
+        // A Yaz0 block made of literals only: one control byte of 0xFF per 8 bytes of data
+        size_t payload_size = nearest_multiple_down<8>((size - 0x10) * 8 / 9);
+        std::vector<uint32_t> code = generate_code(rng, payload_size, vram_base);
+
+        writer.word(0x59617A30); // Yaz0
+        writer.word(static_cast<uint32_t>(payload_size));
+        writer.word(0);
+        writer.word(0);
+        for (size_t i = 0; i < code.size(); i++) {
+            if (i % 2 == 0) {
+                writer.byte_be(0xFF);
+            }
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                writer.byte_be(static_cast<uint8_t>(code[i] >> shift));
+            }
+        }
+        while (writer.offset() % instruction_size != 0) {
+            writer.byte_be(0);
+        }
+    }
+
+    while (writer.offset() < end) {
+        writer.word(rng.next32());
+    }
+}
+
+// Write the header and IPL3 area
+void generate_header(SynthRng& rng, RomWriter& writer) {
+    writer.word(0x80371240);     // PI settings
+    writer.word(0x0000000F);     // Clock rate
+    writer.word(synth_vram_base); // Entrypoint
+    writer.word(0x0000144C);     // Release
+    writer.word(rng.next32());   // CRC1
+    writer.word(rng.next32());   // CRC2
+    writer.word(0);
+    writer.word(0);
+
+    constexpr std::string_view title = "SYNTHETIC ROM       ";
+    for (char c : title) {
+        writer.byte_be(static_cast<uint8_t>(c));
+    }
+    while (writer.offset() < 0x40) {
+        writer.byte_be(0);
+    }
+
+    // IPL3 isn't searched, so fill it with noise
+    while (writer.offset() < rom_code_start) {
+        writer.word(rng.next32());
+    }
+}
+
+const char* synth_segment_type_name(SynthSegmentType type) {
+    switch (type) {
+        case SynthSegmentType::code:
+            return "code";
+        case SynthSegmentType::rsp:
+            return "rsp";
+        case SynthSegmentType::compressed:
+            return "compressed";
+        case SynthSegmentType::padding:
+            return "padding";
+        case SynthSegmentType::data:
+            return "data";
+    }
+    return "unknown";
+}
+
+// Generate an N64-shaped rom from a seed. The same options always produce the same rom.
+SynthRom generate_synthetic_rom(const SynthRomOptions& options) {
+    SynthRom ret{};
+    SynthRng rng{options.seed};
+    size_t rom_size = std::max(nearest_multiple_up<segment_alignment>(options.size), rom_code_start + segment_alignment);
+    ret.bytes.resize(rom_size);
+
+    RomWriter writer{ret.bytes, 0};
+    generate_header(rng, writer);
+
+    const std::array<std::pair<SynthSegmentType, unsigned>, 5> weights{{
+        {SynthSegmentType::code, options.code_weight},
+        {SynthSegmentType::rsp, options.rsp_weight},
+        {SynthSegmentType::compressed, options.compressed_weight},
+        {SynthSegmentType::padding, options.padding_weight},
+        {SynthSegmentType::data, options.data_weight},
+    }};
+    unsigned total_weight = 0;
+    for (const auto& [type, weight] : weights) {
+        total_weight += weight;
+    }
+    if (total_weight == 0) {
+        return ret;
+    }
+
+    uint32_t vram = synth_vram_base;
+
+    while (writer.offset() < rom_size) {
+        // Pick the segment type
+        size_t roll = rng.range(0, total_weight - 1);
+        SynthSegmentType type = SynthSegmentType::code;
+        for (const auto& [candidate, weight] : weights) {
+            if (roll < weight) {
+                type = candidate;
+                break;
+            }
+            roll -= weight;
+        }
+
+        SegmentSizeRange size_range{};
+        switch (type) {
+            case SynthSegmentType::code:       size_range = code_segment_size; break;
+            case SynthSegmentType::rsp:        size_range = rsp_segment_size; break;
+            case SynthSegmentType::compressed: size_range = compressed_segment_size; break;
+            case SynthSegmentType::padding:    size_range = padding_segment_size; break;
+            case SynthSegmentType::data:       size_range = data_segment_size; break;
+        }
+
+        size_t start = writer.offset();
+        size_t size = nearest_multiple_up<segment_alignment>(rng.range(size_range.min, size_range.max));
+        size_t end = std::min(start + size, rom_size);
+
+        switch (type) {
+            case SynthSegmentType::code:
+                for (uint32_t word : generate_code(rng, end - start, vram)) {
+                    writer.word(word);
+                }
+                vram += static_cast<uint32_t>(end - start);
+                break;
+            case SynthSegmentType::rsp:
+                for (uint32_t word : generate_rsp(rng, end - start)) {
+                    writer.word(word);
+                }
+                break;
+            case SynthSegmentType::compressed:
+                generate_compressed(rng, writer, end, 0x80400000);
+                break;
+            case SynthSegmentType::padding: {
+                uint32_t fill = rng.chance(1, 2) ? 0x00000000 : 0xFFFFFFFF;
+                while (writer.offset() < end) {
+                    writer.word(fill);
+                }
+                break;
+            }
+            case SynthSegmentType::data:
+                generate_data(rng, writer, end);
+                break;
+        }
+
+        ret.segments.push_back(SynthSegment{type, start, end});
+    }
+
+    return ret;
+}
+
+// Generate a rom with a switch statement compiled the way the given compiler does it. The jump table goes in rodata
+// after the function, or between the `jr` and the cases if `inline_table` is set.
+SynthSwitchRom generate_switch_rom(SynthCompiler compiler, bool inline_table) {
+    constexpr size_t case_count = 5;
+    // Words in the prologue, in the switch sequence up to and including the `jr`'s delay slot, and in each case
+    constexpr size_t prologue_words = 2;
+    constexpr size_t switch_words = 9;
+    constexpr size_t case_words = 3;
+    constexpr int32_t frame = 0x18;
+
+    SynthSwitchRom ret{};
+    SynthRng rng{1};
+    ret.bytes.resize(rom_code_start + 0x1000);
+    RomWriter writer{ret.bytes, 0};
+    generate_header(rng, writer);
+
+    // The function is loaded right at the start of vram
+    auto vram_of = [](size_t rom_addr) {
+        return synth_vram_base + static_cast<uint32_t>(rom_addr - rom_code_start);
+    };
+    // Offset field of a branch at `from` to `to`
+    auto branch_offset = [](size_t from, size_t to) {
+        return static_cast<int32_t>((static_cast<int64_t>(to) - static_cast<int64_t>(from + instruction_size)) / 4);
+    };
+
+    size_t switch_start = rom_code_start + prologue_words * instruction_size;
+    size_t switch_end = switch_start + switch_words * instruction_size;
+    size_t cases_start = switch_end + (inline_table ? case_count * instruction_size : 0);
+    size_t default_rom = cases_start + case_count * case_words * instruction_size;
+    size_t end_rom = default_rom + instruction_size;
+
+    ret.function_rom_start = rom_code_start;
+    ret.function_rom_end = end_rom + 3 * instruction_size;
+    ret.jr_rom = switch_end - 2 * instruction_size;
+    ret.table_rom_start = inline_table ? switch_end : nearest_multiple_up<16>(ret.function_rom_end);
+    ret.table_rom_end = ret.table_rom_start + case_count * instruction_size;
+    ret.table_vram = vram_of(ret.table_rom_start);
+
+    int32_t table_lo = static_cast<int16_t>(ret.table_vram & 0xFFFF);
+    int32_t table_hi = static_cast<int32_t>((ret.table_vram - static_cast<uint32_t>(table_lo)) >> 16);
+
+    // Prologue
+    writer.word(encode_i(0x09, r_sp, r_sp, -frame));       // addiu $sp, $sp, -frame
+    writer.word(encode_i(0x2B, r_sp, r_ra, frame - 4));    // sw    $ra, frame-4($sp)
+
+    if (compiler == SynthCompiler::ido) {
+        // IDO loads the table entry through $at with the table's %lo as the load offset
+        writer.word(encode_i(0x09, r_a0, r_t6, -1));                            // addiu $t6, $a0, -1
+        writer.word(encode_i(0x0B, r_t6, r_at, case_count));                    // sltiu $at, $t6, count
+        writer.word(encode_i(0x04, r_at, r_zero, branch_offset(writer.offset(), default_rom))); // beqz $at, default
+        writer.word(encode_r(r_zero, r_t6, r_t6, 2, 0x00));                     // sll   $t6, $t6, 2
+        writer.word(encode_i(0x0F, r_zero, r_at, table_hi));                    // lui   $at, %hi(table)
+        writer.word(encode_r(r_at, r_t6, r_at, 0, 0x21));                       // addu  $at, $at, $t6
+        writer.word(encode_i(0x23, r_at, r_t6, table_lo));                      // lw    $t6, %lo(table)($at)
+        writer.word(encode_r(r_t6, r_zero, r_zero, 0, 0x08));                   // jr    $t6
+        writer.word(nop);
+    } else {
+        // GCC builds the full table address first, with the lui in the bounds check's delay slot
+        writer.word(encode_i(0x0B, r_a0, r_v0, case_count));                    // sltiu $v0, $a0, count
+        writer.word(encode_i(0x04, r_v0, r_zero, branch_offset(writer.offset(), default_rom))); // beqz $v0, default
+        writer.word(encode_i(0x0F, r_zero, r_v0, table_hi));                    // lui   $v0, %hi(table)
+        writer.word(encode_i(0x09, r_v0, r_v0, table_lo));                      // addiu $v0, $v0, %lo(table)
+        writer.word(encode_r(r_zero, r_a0, r_v1, 2, 0x00));                     // sll   $v1, $a0, 2
+        writer.word(encode_r(r_v1, r_v0, r_v1, 0, 0x21));                       // addu  $v1, $v1, $v0
+        writer.word(encode_i(0x23, r_v1, r_v0, 0));                             // lw    $v0, 0($v1)
+        writer.word(encode_r(r_v0, r_zero, r_zero, 0, 0x08));                   // jr    $v0
+        writer.word(nop);
+    }
+
+    if (inline_table) {
+        for (size_t i = 0; i < case_count; i++) {
+            writer.word(vram_of(cases_start + i * case_words * instruction_size));
+        }
+    }
+
+    // Each case sets the return value and branches to the epilogue
+    for (size_t i = 0; i < case_count; i++) {
+        writer.word(encode_i(0x09, r_zero, r_v0, static_cast<int32_t>(i + 1)));    // addiu $v0, $zero, i
+        writer.word(encode_i(0x04, r_zero, r_zero, branch_offset(writer.offset(), end_rom))); // b end
+        writer.word(nop);
+    }
+    writer.word(encode_r(r_zero, r_zero, r_v0, 0, 0x25));   // move  $v0, $zero
+
+    // Epilogue
+    writer.word(encode_i(0x23, r_sp, r_ra, frame - 4));     // lw    $ra, frame-4($sp)
+    writer.word(jr_ra);                                     // jr    $ra
+    writer.word(encode_i(0x09, r_sp, r_sp, frame));         // addiu $sp, $sp, frame
+
+    if (!inline_table) {
+        while (writer.offset() < ret.table_rom_start) {
+            writer.word(nop);
+        }
+        for (size_t i = 0; i < case_count; i++) {
+            writer.word(vram_of(cases_start + i * case_words * instruction_size));
+        }
+    }
+
+    return ret;
+}
+
+// Write a rom in host word order to a file as a big-endian (z64) rom, returning false on failure
+bool write_rom_file(const char* path, std::span<const uint8_t> rom_bytes) {
+    FILE* file = std::fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    std::vector<uint8_t> big_endian(rom_bytes.size());
+    for (size_t i = 0; i < rom_bytes.size(); i++) {
+        big_endian[i] = read8_be(rom_bytes, i);
+    }
+
+    bool success = std::fwrite(big_endian.data(), 1, big_endian.size(), file) == big_endian.size();
+    return (std::fclose(file) == 0) && success;
+}
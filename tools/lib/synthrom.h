@@ -0,0 +1,73 @@
+#ifndef __SYNTHROM_H__
+#define __SYNTHROM_H__
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+enum class SynthSegmentType {
+    code,
+    rsp,
+    compressed,
+    padding,
+    data,
+};
+
+// A segment of a synthetic rom and what was generated in it
+struct SynthSegment {
+    SynthSegmentType type;
+    size_t rom_start;
+    size_t rom_end;
+};
+
+struct SynthRomOptions {
+    uint64_t seed = 1;
+    size_t size = 8 * 1024 * 1024;
+    // Relative likelihood of each segment type being picked for the next segment
+    unsigned code_weight = 6;
+    unsigned rsp_weight = 1;
+    unsigned compressed_weight = 3;
+    unsigned padding_weight = 1;
+    unsigned data_weight = 3;
+};
+
+struct SynthRom {
+    // Rom contents in host word order, as returned by `read_rom`
+    std::vector<uint8_t> bytes;
+    // Segments in rom order, covering everything after the header
+    std::vector<SynthSegment> segments;
+};
+
+// Generate an N64-shaped rom from a seed. The same options always produce the same rom.
+SynthRom generate_synthetic_rom(const SynthRomOptions& options);
+
+// Compilers whose switch statement output can be generated
+enum class SynthCompiler {
+    ido,
+    gcc,
+};
+
+// A rom holding a single function with a switch statement, and where its jump table was placed
+struct SynthSwitchRom {
+    // Rom contents in host word order, as returned by `read_rom`
+    std::vector<uint8_t> bytes;
+    // Rom range of the function, including its jump table if the table is inline
+    size_t function_rom_start;
+    size_t function_rom_end;
+    // The `jr` that reads the table, and the table itself
+    size_t jr_rom;
+    size_t table_rom_start;
+    size_t table_rom_end;
+    uint32_t table_vram;
+};
+
+// Generate a rom with a switch statement compiled the way the given compiler does it. The jump table goes in rodata
+// after the function, or between the `jr` and the cases if `inline_table` is set.
+SynthSwitchRom generate_switch_rom(SynthCompiler compiler, bool inline_table);
+
+// Write a rom in host word order to a file as a big-endian (z64) rom, returning false on failure
+bool write_rom_file(const char* path, std::span<const uint8_t> rom_bytes);
+
+const char* synth_segment_type_name(SynthSegmentType type);
+
+#endif
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+#include "reference.h"
+#include "synthrom.h"
+
+constexpr size_t default_seed_count = 8;
+constexpr size_t default_synthetic_size = 4 * 1024 * 1024;
+
+// Segment mixes for the synthetic part of the corpus
+struct SyntheticMix {
+    std::string_view name;
+    SynthRomOptions options;
+};
+
+const SyntheticMix synthetic_mixes[] = {
+    {"default", SynthRomOptions{}},
+    {"code", SynthRomOptions{.code_weight = 12, .rsp_weight = 1, .compressed_weight = 1, .padding_weight = 1, .data_weight = 1}},
+    {"rsp", SynthRomOptions{.code_weight = 4, .rsp_weight = 4, .compressed_weight = 1, .padding_weight = 1, .data_weight = 1}},
+    {"data", SynthRomOptions{.code_weight = 2, .rsp_weight = 1, .compressed_weight = 6, .padding_weight = 3, .data_weight = 6}},
+};
+
+bool same_jump_table(const JumpTable& a, const JumpTable& b) {
+    return a.rom_start == b.rom_start && a.rom_end == b.rom_end && a.vram == b.vram && a.jr_rom == b.jr_rom;
+}
+
+bool same_call(const RegionCall& a, const RegionCall& b) {
+    return a.caller == b.caller && a.target == b.target;
+}
+
+// The call graph is built from these, so they have to match too
+bool same_references(const RegionReferences& a, const RegionReferences& b) {
+    return a.function_starts == b.function_starts && a.return_counts == b.return_counts &&
+        std::equal(a.calls.begin(), a.calls.end(), b.calls.begin(), b.calls.end(), same_call) &&
+        a.jal_targets == b.jal_targets && a.pair_addresses == b.pair_addresses;
+}
+
+// Check if two regions are identical in every field, not just their bounds
+bool same_region(const RomRegion& a, const RomRegion& b) {
+    return a.rom_start == b.rom_start && a.rom_end == b.rom_end && a.has_rsp == b.has_rsp &&
+        a.confidence == b.confidence && a.vram == b.vram && a.vram_confidence == b.vram_confidence &&
+        std::equal(a.jump_tables.begin(), a.jump_tables.end(), b.jump_tables.begin(), b.jump_tables.end(), same_jump_table) &&
+        same_references(a.references, b.references);
+}
+
+std::string describe_region(const RomRegion& region) {
+    return fmt::format("0x{:08X} to 0x{:08X} (0x{:06X}) rsp: {} confidence: {:.4f} vram: 0x{:08X} jump tables: {}",
+        region.rom_start, region.rom_end, region.rom_end - region.rom_start, region.has_rsp, region.confidence,
+        region.vram, region.jump_tables.size());
+}
+
+// Print the regions that differ between the two outputs, in rom order. Returns the number of differing regions.
+size_t print_region_diff(const std::vector<RomRegion>& reference, const std::vector<RomRegion>& production) {
+    size_t differences = 0;
+    size_t ref_index = 0;
+    size_t prod_index = 0;
+
+    while (ref_index < reference.size() || prod_index < production.size()) {
+        const RomRegion* ref = ref_index < reference.size() ? &reference[ref_index] : nullptr;
+        const RomRegion* prod = prod_index < production.size() ? &production[prod_index] : nullptr;
+
+        if (ref != nullptr && prod != nullptr && same_region(*ref, *prod)) {
+            ref_index++;
+            prod_index++;
+            continue;
+        }
+
+        differences++;
+        bool same_bounds = ref != nullptr && prod != nullptr && ref->rom_start == prod->rom_start && ref->rom_end == prod->rom_end;
+        bool ref_first = prod == nullptr ||
+            (ref != nullptr && (ref->rom_start < prod->rom_start || (ref->rom_start == prod->rom_start && ref->rom_end < prod->rom_end)));
+
+        if (same_bounds || ref_first) {
+            fmt::print("    - {}\n", describe_region(*ref));
+            ref_index++;
+        }
+        if (same_bounds || !ref_first) {
+            fmt::print("    + {}\n", describe_region(*prod));
+            prod_index++;
+        }
+    }
+
+    return differences;
+}
+
+// Scan a rom with both implementations and print the differences, returning true if they match
+bool compare_scanners(std::string_view name, std::span<const uint8_t> rom_bytes) {
+    std::vector<RomRegion> reference = reference_find_code_regions(rom_bytes);
+    std::vector<RomRegion> production = find_code_regions(rom_bytes);
+
+    if (reference.size() == production.size() &&
+        std::equal(reference.begin(), reference.end(), production.begin(), same_region)) {
+        fmt::print("  ok    {} ({} regions)\n", name, production.size());
+        return true;
+    }
+
+    fmt::print("  FAIL  {} ({} reference regions, {} production regions)\n", name, reference.size(), production.size());
+    size_t differences = print_region_diff(reference, production);
+    fmt::print("    {} differing regions\n", differences);
+    return false;
+}
+
+// A compiler's switch statement output and whether the table is inline, for checking the jump table idiom matcher
+struct SwitchCase {
+    std::string_view name;
+    SynthCompiler compiler;
+    bool inline_table;
+};
+
+const SwitchCase switch_cases[] = {
+    {"ido rodata table", SynthCompiler::ido, false},
+    {"gcc rodata table", SynthCompiler::gcc, false},
+    {"ido inline table", SynthCompiler::ido, true},
+    {"gcc inline table", SynthCompiler::gcc, true},
+};
+
+// Link the jump table of a generated switch statement and check that it's found with the bounds check's size, returning
+// true if it matches. An inline table splits the function in two, which linking has to merge back together.
+bool check_switch(const SwitchCase& test) {
+    SynthSwitchRom rom = generate_switch_rom(test.compiler, test.inline_table);
+
+    std::vector<RomRegion> regions{};
+    if (test.inline_table) {
+        regions.emplace_back(rom.function_rom_start, rom.table_rom_start);
+        regions.emplace_back(rom.table_rom_end, rom.function_rom_end);
+    } else {
+        regions.emplace_back(rom.function_rom_start, rom.function_rom_end);
+    }
+    RomWordIndex word_index = build_rom_word_index(rom.bytes);
+    link_jump_tables(regions, rom_code_start, rom.bytes, [&rom, &word_index](size_t start, size_t end) {
+        return check_range_cpu(start, end, rom.bytes, word_index);
+    });
+
+    JumpTable expected{
+        .rom_start = rom.table_rom_start,
+        .rom_end = rom.table_rom_end,
+        .vram = rom.table_vram,
+        .jr_rom = rom.jr_rom,
+    };
+    if (regions.size() == 1 && regions[0].rom_start == rom.function_rom_start && regions[0].rom_end == rom.function_rom_end &&
+        regions[0].jump_tables.size() == 1 && same_jump_table(regions[0].jump_tables[0], expected))
+    {
+        fmt::print("  ok    {}\n", test.name);
+        return true;
+    }
+
+    fmt::print("  FAIL  {} (expected one region 0x{:08X} to 0x{:08X} with the table 0x{:08X} to 0x{:08X})\n",
+        test.name, rom.function_rom_start, rom.function_rom_end, rom.table_rom_start, rom.table_rom_end);
+    for (const RomRegion& region : regions) {
+        fmt::print("    {}\n", describe_region(region));
+        for (const JumpTable& table : region.jump_tables) {
+            fmt::print("      table 0x{:08X} to 0x{:08X} for jr at 0x{:08X}\n", table.rom_start, table.rom_end, table.jr_rom);
+        }
+    }
+    return false;
+}
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [roms...]\n", program_name);
+    fmt::print("Checks that find_code_regions matches the frozen reference implementation on a synthetic corpus and any given roms,\n");
+    fmt::print("and that jump tables are found in compiler-shaped switch statements.\n");
+    fmt::print("Options:\n");
+    fmt::print("  --seeds N  Number of seeds to generate synthetic roms from for each segment mix (default {})\n", default_seed_count);
+    fmt::print("  --size N   Size of each synthetic rom in bytes (default {})\n", default_synthetic_size);
+}
+
+int main(int argc, char* argv[]) {
+    size_t seed_count = default_seed_count;
+    size_t synthetic_size = default_synthetic_size;
+    std::vector<const char*> rom_paths{};
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--seeds" && i + 1 < argc) {
+            seed_count = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--size" && i + 1 < argc) {
+            synthetic_size = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg.starts_with("--")) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            rom_paths.push_back(argv[i]);
+        }
+    }
+
+    size_t failures = 0;
+    size_t total = 0;
+
+    fmt::print("Jump table idioms:\n");
+    for (const SwitchCase& test : switch_cases) {
+        failures += !check_switch(test);
+        total++;
+    }
+
+    fmt::print("Synthetic roms:\n");
+    for (const SyntheticMix& mix : synthetic_mixes) {
+        for (uint64_t seed = 1; seed <= seed_count; seed++) {
+            SynthRomOptions options = mix.options;
+            options.seed = seed;
+            options.size = synthetic_size;
+            SynthRom rom = generate_synthetic_rom(options);
+
+            std::string name = fmt::format("{} seed {}", mix.name, seed);
+            failures += !compare_scanners(name, rom.bytes);
+            total++;
+        }
+    }
+
+    if (!rom_paths.empty()) {
+        fmt::print("Roms:\n");
+    }
+    for (const char* rom_path : rom_paths) {
+        if (!std::filesystem::exists(rom_path)) {
+            fmt::print(stderr, "No such file: {}\n", rom_path);
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> rom_bytes = read_rom(rom_path);
+        failures += !compare_scanners(rom_path, rom_bytes);
+        total++;
+    }
+
+    fmt::print("{} of {} checks passed\n", total - failures, total);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+#include <cstdlib>
+#include <string_view>
+
+#include "fmt/format.h"
+
+#include "findcode.h"
+#include "synthrom.h"
+
+void print_usage(const char* program_name) {
+    fmt::print("Usage: {} [options] [output rom]\n", program_name);
+    fmt::print("Generates a deterministic N64-shaped rom for benchmarking and testing findcode.\n");
+    fmt::print("Options:\n");
+    fmt::print("  --seed N        Seed for the generator (default 1)\n");
+    fmt::print("  --size N        Size of the rom in bytes (default 8MB)\n");
+    fmt::print("  --code N        Relative weight of code segments (default 6)\n");
+    fmt::print("  --rsp N         Relative weight of RSP microcode segments (default 1)\n");
+    fmt::print("  --compressed N  Relative weight of compressed segments (default 3)\n");
+    fmt::print("  --padding N     Relative weight of padding segments (default 1)\n");
+    fmt::print("  --data N        Relative weight of data table segments (default 3)\n");
+    fmt::print("  --map           Print the generated segments\n");
+}
+
+int main(int argc, char* argv[]) {
+    SynthRomOptions options{};
+    const char* output_path = nullptr;
+    bool print_map = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--map") {
+            print_map = true;
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--size" && has_value) {
+            options.size = std::strtoull(argv[++i], nullptr, 0);
+        } else if (arg == "--code" && has_value) {
+            options.code_weight = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--rsp" && has_value) {
+            options.rsp_weight = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--compressed" && has_value) {
+            options.compressed_weight = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--padding" && has_value) {
+            options.padding_weight = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg == "--data" && has_value) {
+            options.data_weight = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        } else if (arg.starts_with("--") || output_path != nullptr) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            output_path = argv[i];
+        }
+    }
+
+    if (output_path == nullptr) {
+        print_usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    SynthRom rom = generate_synthetic_rom(options);
+
+    if (!write_rom_file(output_path, rom.bytes)) {
+        fmt::print(stderr, "Failed to write rom file {}\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    if (print_map) {
+        for (const SynthSegment& segment : rom.segments) {
+            fmt::print("0x{:08X} 0x{:08X} {}\n", segment.rom_start, segment.rom_end, synth_segment_type_name(segment.type));
+        }
+    }
+
+    return EXIT_SUCCESS;
+}